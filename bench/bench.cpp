@@ -0,0 +1,513 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <oodle/Oodle1.h>
+#include <oodle/Oodle1Batch.h>
+#include <oodle/Oodle1Compressor.h>
+#include <thread>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "Format.h"
+#include "Granny.h"
+#include "GrannyWriter.h"
+
+// Every benchmark prints one JSON object per line, e.g.
+//   {"group":"bitstream","name":"get/one=65","bytes":5242880,"symbols":4194304,"seconds":0.012,
+//    "mb_per_s":436.9,"cycles_per_byte":5.1,"ns_per_symbol":2.86}
+// bytes is the compressed input read by the bitstream and decoder benchmarks, and the decompressed output
+// written by the LZ, section, batch and index benchmarks. Each figure is the best of --iterations runs. Cycles are those of
+// the time-stamp counter, and are null where there isn't one.
+
+namespace {
+
+using Oodle::Oodle1BitstreamWriter;
+
+volatile uint32_t sink = 0u;	// Keeps the results of each benchmark observable, so that it isn't optimized away
+unsigned iterations = 5u;
+
+uint64_t ReadCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0u;
+#endif
+}
+
+std::string Number(double value) {
+	return std::isfinite(value) ? Formatted("%.4g", value) : std::string("null");
+}
+
+template <typename Body> void Run(const char *group, const std::string& name, size_t bytes, size_t symbols, Body&& body) {
+	auto bestSeconds = std::numeric_limits<double>::infinity();
+	uint64_t bestCycles = 0u;
+	for (auto iteration = 0u; iteration < iterations; iteration++) {
+		const auto startTime = std::chrono::steady_clock::now();
+		const auto startCycles = ReadCycles();
+		body();
+		const auto cycles = ReadCycles() - startCycles;
+		const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		if (seconds < bestSeconds) {
+			bestSeconds = seconds;
+			bestCycles = cycles;
+		}
+	}
+	const auto cyclesPerByte = bestCycles ? (static_cast<double>(bestCycles) / bytes) : std::numeric_limits<double>::quiet_NaN();
+	std::cout << Formatted("{\"group\":\"%s\",\"name\":\"%s\",\"bytes\":%zu,\"symbols\":%zu,\"seconds\":%s,\"mb_per_s\":%s,\"cycles_per_byte\":%s,\"ns_per_symbol\":%s}",
+			group, name.c_str(), bytes, symbols, Number(bestSeconds).c_str(), Number(bytes / bestSeconds / 1e6).c_str(),
+			Number(cyclesPerByte).c_str(), Number(bestSeconds * 1e9 / symbols).c_str()) << std::endl;
+}
+
+void BenchBitstream(std::mt19937& rng) {
+	constexpr auto SymbolCount = 1u << 22;
+	for (const auto one : { 4u, 65u, 256u, Oodle::Oodle1Decoder<256>::One }) {
+		std::vector<uint32_t> values(SymbolCount);
+		Oodle1BitstreamWriter writer;
+		for (auto& value : values) {
+			value = rng() % one;
+			writer.Put(value, one);
+		}
+		const auto input = writer.Finish();
+		Run("bitstream", Formatted("get/one=%u", one), input.size(), SymbolCount, [&]() {
+			Oodle::Oodle1Bitstream bs(input.data(), input.size());
+			uint32_t total = 0u;
+			for (auto idx = 0u; idx < SymbolCount; idx++) {
+				total += bs.Get(one);
+			}
+			sink = total;
+		});
+		if (one == 256u) {
+			Run("bitstream", "get<256>", input.size(), SymbolCount, [&]() {
+				Oodle::Oodle1Bitstream bs(input.data(), input.size());
+				uint32_t total = 0u;
+				for (auto idx = 0u; idx < SymbolCount; idx++) {
+					total += bs.Get<256>();
+				}
+				sink = total;
+			});
+		}
+	}
+
+	// Peek and Consume as the symbol decoders use them, on the fixed-point 1.0 and with ranges of varying widths
+	constexpr auto One = Oodle::Oodle1Decoder<256>::One;
+	std::vector<std::pair<uint16_t,uint16_t>> ranges(SymbolCount);
+	Oodle1BitstreamWriter writer;
+	for (auto& range : ranges) {
+		const auto span = 1u + (rng() % 0x400u);
+		const auto minZ = rng() % (One - span + 1);
+		range = { static_cast<uint16_t>(minZ), static_cast<uint16_t>(span) };
+		writer.Put(minZ, span, One);
+	}
+	const auto input = writer.Finish();
+	Run("bitstream", Formatted("peek+consume/one=%u", One), input.size(), SymbolCount, [&]() {
+		Oodle::Oodle1Bitstream bs(input.data(), input.size());
+		uint32_t total = 0u;
+		for (const auto& range : ranges) {
+			total += bs.Peek(One);
+			bs.Consume(range.first, range.second, One);
+		}
+		sink = total;
+	});
+	Run("bitstream", Formatted("peek+consume<%u>", One), input.size(), SymbolCount, [&]() {
+		Oodle::Oodle1Bitstream bs(input.data(), input.size());
+		uint32_t total = 0u;
+		for (const auto& range : ranges) {
+			total += bs.Peek<One>();
+			bs.Consume<One>(range.first, range.second);
+		}
+		sink = total;
+	});
+}
+
+template <uint32_t Capacity> void BenchDecoder(std::mt19937& rng) {
+	constexpr auto SymbolCount = 1u << 22;
+	// Skewed symbols are mostly drawn from the first few, as lengths and literals in structured data tend to be
+	std::geometric_distribution<uint32_t> skewed(std::min(0.5, 8.0 / Capacity));
+	for (const auto skew : { true, false }) {
+		std::vector<uint32_t> symbols(SymbolCount);
+		Oodle1BitstreamWriter writer;
+		auto encoder = std::make_unique<Oodle::Oodle1Encoder<Capacity>>();
+		encoder->Initialize(Capacity, Capacity);
+		for (auto& symbol : symbols) {
+			symbol = skew ? std::min(skewed(rng), Capacity - 1) : (rng() % Capacity);
+			encoder->Encode(writer, symbol, Capacity);
+		}
+		const auto input = writer.Finish();
+		auto decoder = std::make_unique<Oodle::Oodle1Decoder<Capacity>>();
+		Run("decoder", Formatted("decode/alphabet=%u/%s", Capacity, skew ? "skewed" : "uniform"), input.size(), SymbolCount, [&]() {
+			Oodle::Oodle1Bitstream bs(input.data(), input.size());
+			decoder->Initialize(Capacity, Capacity);
+			uint32_t total = 0u;
+			for (auto idx = 0u; idx < SymbolCount; idx++) {
+				total += decoder->Decode(bs, Capacity);
+			}
+			sink = total;
+		});
+	}
+}
+
+struct RepeatMix {
+	uint32_t minOffset;
+	uint32_t maxOffset;
+	uint32_t minLength;
+	uint32_t maxLength;
+};
+
+// Repeat lengths are drawn from those the format can code: 2 through 61, then 128, 192, 256 and 512
+uint32_t CodableLength(uint32_t length) {
+	return (length <= 61u) ? length : (length < 192u) ? 128u : (length < 256u) ? 192u : (length < 512u) ? 256u : 512u;
+}
+
+void BenchRepeats(std::mt19937& rng) {
+	constexpr auto OutputSize = 8u << 20;
+	// A single literal separates each repeat, so the mix's offsets and lengths dominate the decode. Zero offsets
+	// mean a stream of literals alone.
+	const std::array<RepeatMix,7> mixes = { {
+		{ 0u, 0u, 0u, 0u },
+		{ 1u, 3u, 2u, 8u },
+		{ 4u, 15u, 2u, 8u },
+		{ 16u, 1024u, 2u, 8u },
+		{ 16u, 1024u, 16u, 61u },
+		{ 4u, 15u, 128u, 512u },
+		{ 1024u, 0x10000u, 128u, 512u },
+	} };
+	auto compressor = std::make_unique<Oodle::Oodle1Compressor>();
+	auto decomp = std::make_unique<Oodle::Oodle1Decompressor>();
+	std::vector<uint8_t> output(OutputSize + Oodle::Oodle1Decompressor::RepeatSlack);
+	for (const auto& mix : mixes) {
+		std::vector<uint8_t> data;
+		std::vector<Oodle::Oodle1Compressor::Token> tokens;
+		data.reserve(OutputSize);
+		while (data.size() < OutputSize) {
+			data.push_back(static_cast<uint8_t>(rng()));
+			tokens.push_back({ 1u, 0u });
+			const auto maxOffset = std::min<uint32_t>(mix.maxOffset, static_cast<uint32_t>(data.size()));
+			const auto length = CodableLength(mix.minLength + (rng() % (mix.maxLength - mix.minLength + 1)));
+			if (mix.maxOffset && (maxOffset >= mix.minOffset) && ((data.size() + length) <= OutputSize)) {
+				const auto offset = mix.minOffset + static_cast<uint32_t>(rng() % (maxOffset - mix.minOffset + 1));
+				for (auto idx = 0u; idx < length; idx++) {
+					data.push_back(data[data.size() - offset]);
+				}
+				tokens.push_back({ length, offset });
+			}
+		}
+		std::array<uint32_t,Oodle::Oodle1Compressor::HeaderWords> header;
+		if (!compressor->Compress(data.data(), tokens, header.data())) {
+			std::cerr << "Failed to compress a repeat benchmark's input" << std::endl;
+			continue;
+		}
+		const auto input = compressor->Finish();
+		const auto name = mix.maxOffset ? Formatted("repeat/offset=%u-%u/length=%u-%u", mix.minOffset, mix.maxOffset, mix.minLength, mix.maxLength) : std::string("literals");
+		Run("lz", name, data.size(), tokens.size(), [&]() {
+			Oodle::Oodle1Bitstream bs(input.data(), input.size());
+			decomp->Reset(bs, header.data());
+			sink = static_cast<uint32_t>(decomp->Decompress(output.data(), data.size(), true));
+		});
+		if (std::memcmp(output.data(), data.data(), data.size()) != 0) {
+			std::cerr << Formatted("Repeat benchmark %s decoded incorrectly", name.c_str()) << std::endl;
+		}
+	}
+}
+
+std::vector<uint8_t> SyntheticSection(std::mt19937& rng, const std::string& kind, size_t size) {
+	std::vector<uint8_t> data;
+	data.reserve(size);
+	if (kind == "text") {
+		static const char *words[] = { "mesh ", "bone ", "vertex ", "texture ", "skeleton ", "animation ", "track ", "curve ", "\n", "0.0 ", "1.0 " };
+		while (data.size() < size) {
+			const auto word = words[rng() % std::size(words)];
+			data.insert(data.end(), word, word + std::strlen(word));
+		}
+	} else if (kind == "vertices") {
+		// Position, normal and texture coordinates, drifting slowly as they would across a mesh
+		std::array<float,8> vertex = { 0.0f };
+		while (data.size() < size) {
+			for (auto& component : vertex) {
+				component += static_cast<float>(static_cast<int32_t>(rng() % 64u) - 32) / 1024.0f;
+			}
+			const auto bytes = reinterpret_cast<const uint8_t*>(vertex.data());
+			data.insert(data.end(), bytes, bytes + sizeof(vertex));
+		}
+	} else {
+		while (data.size() < size) {
+			data.push_back(static_cast<uint8_t>(rng()));
+		}
+	}
+	data.resize(size);
+	return data;
+}
+
+void BenchSection(const std::string& name, const std::vector<uint8_t>& file) {
+	GrannyFile granny;
+	if (!granny.LoadHeaders(file.data(), file.size())) {
+		std::cerr << Formatted("Failed to load %s for benchmarking", name.c_str()) << std::endl;
+		return;
+	}
+	const auto outputSize = granny.GetDataSize() + Oodle::Oodle1Decompressor::RepeatSlack;
+	std::unique_ptr<uint8_t[]> output(new uint8_t[outputSize]);
+	// Tokens aren't counted, so ns_per_symbol is per byte here
+	Run("section", name, granny.GetDataSize(), granny.GetDataSize(), [&]() {
+		sink = granny.Decompress(output.get(), outputSize);
+	});
+	GrannyLoadOptions options;
+	options.parallelStreams = true;
+	options.streamStarts = granny.GetStreamStarts();
+	Run("section", name + "/parallel-streams", granny.GetDataSize(), granny.GetDataSize(), [&]() {
+		sink = granny.Decompress(output.get(), outputSize, options);
+	});
+	options.interleaveStreams = true;
+	Run("section", name + "/interleaved-streams", granny.GetDataSize(), granny.GetDataSize(), [&]() {
+		sink = granny.Decompress(output.get(), outputSize, options);
+	});
+	GrannyLoadOptions verifyOptions;
+	verifyOptions.verifyCrc = true;
+	Run("section", name + "/verify-crc", granny.GetDataSize(), granny.GetDataSize(), [&]() {
+		sink = granny.Decompress(output.get(), outputSize, verifyOptions);
+	});
+	// The first run fills the cache, and every later one is served from it
+	char cacheDirectory[] = "/tmp/oodle_bench.XXXXXX";
+	if (mkdtemp(cacheDirectory)) {
+		GrannyCache cache(cacheDirectory);
+		GrannyLoadOptions cacheOptions;
+		cacheOptions.cache = &cache;
+		Run("section", name + "/cached", granny.GetDataSize(), granny.GetDataSize(), [&]() {
+			sink = granny.Decompress(output.get(), outputSize, cacheOptions);
+		});
+		if (const auto dir = opendir(cacheDirectory)) {
+			while (const auto entry = readdir(dir)) {
+				if (entry->d_name[0] != '.') {
+					unlink(Formatted("%s/%s", cacheDirectory, entry->d_name).c_str());
+				}
+			}
+			closedir(dir);
+		}
+		rmdir(cacheDirectory);
+	}
+}
+
+void BenchSections(std::mt19937& rng, const std::vector<std::string>& filenames) {
+	constexpr auto SectionSize = 4u << 20;
+	for (const auto kind : { "text", "vertices", "random" }) {
+		const auto data = SyntheticSection(rng, kind, SectionSize);
+		GrannyWriter writer;
+		GrannyWriter::Section section;
+		section.data = data.data();
+		section.size = static_cast<uint32_t>(data.size());
+		writer.sections.push_back(section);
+		std::vector<uint8_t> file;
+		if (writer.Write(file)) {
+			BenchSection(Formatted("synthetic-%s", kind), file);
+		}
+	}
+	for (const auto& filename : filenames) {
+		std::ifstream inFile(filename, std::ios::binary);
+		if (!inFile.is_open()) {
+			std::cerr << Formatted("Can't read from %s", filename.c_str()) << std::endl;
+			continue;
+		}
+		const std::vector<uint8_t> file((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+		BenchSection(filename, file);
+	}
+}
+
+// Many tiny streams, each of which would otherwise need a decompressor of its own; ns_per_symbol is per stream
+void BenchBatch(std::mt19937& rng) {
+	constexpr auto BlobCount = 8192u;
+	const auto text = SyntheticSection(rng, "text", BlobCount * 1024u);
+	std::vector<std::array<uint32_t,Oodle::Oodle1Compressor::HeaderWords>> headers(BlobCount);
+	std::vector<std::vector<uint8_t>> inputs(BlobCount);
+	std::vector<Oodle::Oodle1BatchJob> jobs(BlobCount);
+	std::vector<uint8_t> output(text.size());
+	Oodle::Oodle1Compressor compressor;
+	size_t bytes = 0u;
+	for (auto blobIdx = 0u; blobIdx < BlobCount; blobIdx++) {
+		const auto length = 64u + (rng() % 961u);
+		compressor.Compress(&text[bytes], length, headers[blobIdx].data());
+		inputs[blobIdx] = compressor.Finish();
+		auto& job = jobs[blobIdx];
+		job.header = headers[blobIdx].data();
+		job.input = inputs[blobIdx].data();
+		job.inputLength = inputs[blobIdx].size();
+		job.output = &output[bytes];
+		job.outputLength = length;
+		bytes += length;
+	}
+	Run("batch", "new-decompressor-per-stream", bytes, BlobCount, [&]() {
+		for (const auto& job : jobs) {
+			Oodle::Oodle1Bitstream bs(job.input, job.inputLength);
+			auto decomp = std::make_unique<Oodle::Oodle1Decompressor>();
+			decomp->Reset(bs, job.header);
+			sink = static_cast<uint32_t>(decomp->Decompress<Oodle::Oodle1Checked>(job.output, job.outputLength));
+		}
+	});
+	Oodle::Oodle1BatchDecompressor batch;
+	Run("batch", "threads=1", bytes, BlobCount, [&]() {
+		sink = batch.Decompress(jobs);
+	});
+	Oodle::Oodle1BatchDecompressor interleavedBatch(1u, Oodle::Oodle1Decompressor::MaxLanes);
+	Run("batch", Formatted("threads=1/lanes=%u", Oodle::Oodle1Decompressor::MaxLanes), bytes, BlobCount, [&]() {
+		sink = interleavedBatch.Decompress(jobs);
+	});
+	// With a single CPU, this would only repeat the threads=1 row under the same name
+	const auto threads = std::thread::hardware_concurrency();
+	if (threads > 1u) {
+		Oodle::Oodle1BatchDecompressor threadedBatch(threads);
+		Run("batch", Formatted("threads=%u", threads), bytes, BlobCount, [&]() {
+			sink = threadedBatch.Decompress(jobs);
+		});
+	}
+	if (std::memcmp(output.data(), text.data(), bytes) != 0) {
+		std::cerr << "Batch benchmark output doesn't match its input" << std::endl;
+	}
+}
+
+// The last 64KiB of a large stream, decoded from its start and then read through a checkpoint index
+void BenchIndex(std::mt19937& rng) {
+	constexpr auto StreamSize = 16u << 20;
+	constexpr auto ReadSize = 0x10000u;
+	const auto text = SyntheticSection(rng, "text", StreamSize);
+	Oodle::Oodle1Compressor compressor;
+	std::array<uint32_t,Oodle::Oodle1Compressor::HeaderWords> header;
+	compressor.Compress(text.data(), text.size(), header.data());
+	auto input = compressor.Finish();
+	input.resize(input.size() + Oodle::Oodle1Decompressor::MaxTokenInput);
+	std::vector<uint8_t> output(text.size());
+	Oodle::Oodle1CheckpointIndex index;
+	Run("index", "build", text.size(), text.size(), [&]() {
+		sink = index.Build(header.data(), input.data(), input.size(), output.data(), output.size());
+	});
+	const auto offset = text.size() - ReadSize;
+	auto decomp = std::make_unique<Oodle::Oodle1Decompressor>();
+	Run("index", "tail/from-start", ReadSize, ReadSize, [&]() {
+		Oodle::Oodle1Bitstream bs(input.data(), input.size());
+		decomp->Reset(bs, header.data());
+		sink = static_cast<uint32_t>(decomp->Decompress<Oodle::Oodle1Checked>(output.data(), output.size()));
+	});
+	Run("index", Formatted("tail/from-checkpoint/interval=%u", Oodle::Oodle1CheckpointIndex::DefaultInterval), ReadSize, ReadSize, [&]() {
+		sink = static_cast<uint32_t>(index.Read(input.data(), input.size(), offset, &output[offset], ReadSize));
+	});
+	std::vector<uint8_t> saved;
+	index.Save(saved);
+	std::cerr << Formatted("Checkpoint index: %zu checkpoints, %zu bytes, for %zu bytes of input", index.GetCheckpointCount(), saved.size(), input.size()) << std::endl;
+	if (std::memcmp(output.data(), text.data(), text.size()) != 0) {
+		std::cerr << "Index benchmark output doesn't match its input" << std::endl;
+	}
+}
+
+// MaxLanes streams decoded one after another, and then interleaved on one thread, first with no lane allowed
+// slack, and then with every other lane allowed it (as a section's last stream is), which should be no slower
+void BenchLanes(std::mt19937& rng) {
+	constexpr auto StreamSize = 1u << 20;
+	constexpr auto LaneCount = Oodle::Oodle1Decompressor::MaxLanes;
+	const auto text = SyntheticSection(rng, "text", LaneCount * StreamSize);
+	std::array<std::array<uint32_t,Oodle::Oodle1Compressor::HeaderWords>,LaneCount> headers;
+	std::array<std::vector<uint8_t>,LaneCount> inputs;
+	std::array<std::vector<uint8_t>,LaneCount> outputs;
+	std::array<std::unique_ptr<Oodle::Oodle1Decompressor>,LaneCount> decomps;
+	Oodle::Oodle1Compressor compressor;
+	for (auto laneIdx = 0u; laneIdx < LaneCount; laneIdx++) {
+		compressor.Compress(&text[laneIdx * StreamSize], StreamSize, headers[laneIdx].data());
+		inputs[laneIdx] = compressor.Finish();
+		outputs[laneIdx].resize(StreamSize + Oodle::Oodle1Decompressor::RepeatSlack);
+		decomps[laneIdx] = std::make_unique<Oodle::Oodle1Decompressor>();
+	}
+	Run("lanes", "serial", text.size(), text.size(), [&]() {
+		for (auto laneIdx = 0u; laneIdx < LaneCount; laneIdx++) {
+			Oodle::Oodle1Bitstream bs(inputs[laneIdx].data(), inputs[laneIdx].size());
+			decomps[laneIdx]->Reset(bs, headers[laneIdx].data());
+			sink = static_cast<uint32_t>(decomps[laneIdx]->Decompress<Oodle::Oodle1Checked>(outputs[laneIdx].data(), StreamSize));
+		}
+	});
+	for (const auto mixedSlack : { false, true }) {
+		Run("lanes", Formatted("interleaved/lanes=%u%s", LaneCount, mixedSlack ? "/mixed-slack" : ""), text.size(), text.size(), [&]() {
+			std::vector<Oodle::Oodle1Bitstream> streams;
+			std::array<Oodle::Oodle1Lane,LaneCount> lanes;
+			for (auto laneIdx = 0u; laneIdx < LaneCount; laneIdx++) {
+				streams.emplace_back(inputs[laneIdx].data(), inputs[laneIdx].size());
+			}
+			for (auto laneIdx = 0u; laneIdx < LaneCount; laneIdx++) {
+				auto& lane = lanes[laneIdx];
+				lane.decomp = decomps[laneIdx].get();
+				lane.decomp->Reset(streams[laneIdx], headers[laneIdx].data());
+				lane.output = outputs[laneIdx].data();
+				lane.length = StreamSize;
+				lane.outputSlack = mixedSlack && (laneIdx % 2u);
+			}
+			Oodle::Oodle1Decompressor::DecompressInterleaved<Oodle::Oodle1Checked>(lanes.data(), lanes.size());
+			sink = static_cast<uint32_t>(lanes[0].decompressed);
+		});
+	}
+	for (auto laneIdx = 0u; laneIdx < LaneCount; laneIdx++) {
+		if (std::memcmp(outputs[laneIdx].data(), &text[laneIdx * StreamSize], StreamSize) != 0) {
+			std::cerr << "Lanes benchmark output doesn't match its input" << std::endl;
+			break;
+		}
+	}
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<std::string> filenames;
+	for (auto argIdx = 1; argIdx < argc; argIdx++) {
+		const std::string arg(argv[argIdx]);
+		if ((arg == "--iterations") && ((argIdx + 1) < argc)) {
+			iterations = std::max(std::stoi(argv[++argIdx]), 1);
+		} else if (arg.substr(0, 2) == "--") {
+			std::cerr << "Usage: oodle_bench [--iterations <count>] [Granny filenames...]" << std::endl;
+			return 0;
+		} else {
+			filenames.push_back(arg);
+		}
+	}
+#ifndef __OPTIMIZE__
+	std::cerr << "oodle_bench was built without optimization, so its numbers won't be representative" << std::endl;
+#endif
+	// A fixed seed keeps every run's inputs, and so its numbers, comparable with every other run's
+	std::mt19937 rng(1u);
+	BenchBitstream(rng);
+	BenchDecoder<4>(rng);
+	BenchDecoder<65>(rng);
+	BenchDecoder<256>(rng);
+	BenchRepeats(rng);
+	BenchSections(rng, filenames);
+	BenchBatch(rng);
+	BenchIndex(rng);
+	BenchLanes(rng);
+	return 0;
+}
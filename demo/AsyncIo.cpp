@@ -0,0 +1,220 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include "AsyncIo.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <vector>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register) && defined(IORING_FEAT_RW_CUR_POS)
+#define ASYNCIO_HAVE_IO_URING
+#endif
+#endif
+
+#ifdef ASYNCIO_HAVE_IO_URING
+// IORING_OP_READ and IORING_OP_WRITE arrived in Linux 5.6, along with the probe for them, so an older kernel's ring
+// fails the probe rather than failing every request
+static bool SupportsReadWrite(int ringFd) {
+	constexpr auto OpCount = static_cast<unsigned>(IORING_OP_WRITE) + 1u;
+	std::vector<uint8_t> storage(sizeof(io_uring_probe) + (OpCount * sizeof(io_uring_probe_op)));
+	const auto probe = reinterpret_cast<io_uring_probe*>(storage.data());
+	if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, OpCount) < 0) {
+		return false;
+	}
+	const auto supported = [&](unsigned op) {
+		return (op <= probe->last_op) && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+	};
+	return supported(IORING_OP_READ) && supported(IORING_OP_WRITE);
+}
+#endif
+
+AsyncIo::AsyncIo(unsigned depth_) : depth(depth_ ? depth_ : 1u) {
+#ifdef ASYNCIO_HAVE_IO_URING
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	const auto fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+	if (fd < 0) {
+		return;
+	} else if (!SupportsReadWrite(fd)) {
+		close(fd);
+		return;
+	}
+	// The kernel may round the depth up, but never beyond what the completion ring can hold
+	sqMappingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	cqMappingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		sqMappingSize = cqMappingSize = (sqMappingSize > cqMappingSize) ? sqMappingSize : cqMappingSize;
+	}
+	sqMapping = mmap(nullptr, sqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sqMapping == MAP_FAILED) {
+		sqMapping = nullptr;
+		close(fd);
+		return;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		cqMapping = sqMapping;
+	} else {
+		cqMapping = mmap(nullptr, cqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	}
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if ((cqMapping == MAP_FAILED) || (sqes == MAP_FAILED)) {
+		if (cqMapping != MAP_FAILED && cqMapping != sqMapping) {
+			munmap(cqMapping, cqMappingSize);
+		}
+		if (sqes != MAP_FAILED) {
+			munmap(sqes, sqesSize);
+		}
+		munmap(sqMapping, sqMappingSize);
+		sqMapping = cqMapping = sqes = nullptr;
+		close(fd);
+		return;
+	}
+	const auto sq = static_cast<uint8_t*>(sqMapping);
+	const auto cq = static_cast<uint8_t*>(cqMapping);
+	sqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+	sqMask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+	sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+	cqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+	cqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+	cqMask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+	cqes = cq + params.cq_off.cqes;
+	ringFd = fd;
+#endif
+}
+
+AsyncIo::~AsyncIo() {
+#ifdef ASYNCIO_HAVE_IO_URING
+	if (ringFd >= 0) {
+		// Requests still in flight would write into buffers their owners are about to free
+		try {
+			while (inFlight) {
+				Wait();
+			}
+		} catch (const std::runtime_error&) {
+		}
+		munmap(sqes, sqesSize);
+		if (cqMapping != sqMapping) {
+			munmap(cqMapping, cqMappingSize);
+		}
+		munmap(sqMapping, sqMappingSize);
+		close(ringFd);
+	}
+#endif
+}
+
+bool AsyncIo::Read(int fd, void *buffer, uint32_t length, uint64_t offset, uint64_t tag) {
+#ifdef ASYNCIO_HAVE_IO_URING
+	if (ringFd >= 0) {
+		return Queue(IORING_OP_READ, fd, reinterpret_cast<uintptr_t>(buffer), length, offset, tag);
+	}
+#endif
+	if (IsFull()) {
+		return false;
+	}
+	const auto result = pread(fd, buffer, length, static_cast<off_t>(offset));
+	done.push_back({tag, (result < 0) ? -errno : result});
+	inFlight++;
+	return true;
+}
+
+bool AsyncIo::Write(int fd, const void *buffer, uint32_t length, uint64_t offset, uint64_t tag) {
+#ifdef ASYNCIO_HAVE_IO_URING
+	if (ringFd >= 0) {
+		return Queue(IORING_OP_WRITE, fd, reinterpret_cast<uintptr_t>(buffer), length, offset, tag);
+	}
+#endif
+	if (IsFull()) {
+		return false;
+	}
+	const auto result = pwrite(fd, buffer, length, static_cast<off_t>(offset));
+	done.push_back({tag, (result < 0) ? -errno : result});
+	inFlight++;
+	return true;
+}
+
+bool AsyncIo::Queue(uint8_t opcode, int fd, uint64_t buffer, uint32_t length, uint64_t offset, uint64_t tag) {
+#ifdef ASYNCIO_HAVE_IO_URING
+	if (IsFull()) {
+		return false;
+	}
+	// This is the submission ring's only producer, so only the kernel's reads of the tail need ordering
+	const auto tail = *sqTail;
+	const auto index = tail & sqMask;
+	auto& sqe = static_cast<io_uring_sqe*>(sqes)[index];
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = opcode;
+	sqe.fd = fd;
+	sqe.addr = buffer;
+	sqe.len = length;
+	sqe.off = offset;
+	sqe.user_data = tag;
+	sqArray[index] = index;
+	__atomic_store_n(sqTail, tail + 1u, __ATOMIC_RELEASE);
+	unsubmitted++;
+	inFlight++;
+	return true;
+#else
+	(void)opcode, (void)fd, (void)buffer, (void)length, (void)offset, (void)tag;
+	return false;
+#endif
+}
+
+AsyncIo::Completion AsyncIo::Wait() {
+	Completion completion;
+#ifdef ASYNCIO_HAVE_IO_URING
+	if (ringFd >= 0) {
+		for (;;) {
+			const auto head = *cqHead;
+			if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+				const auto& cqe = static_cast<const io_uring_cqe*>(cqes)[head & cqMask];
+				completion.tag = cqe.user_data;
+				completion.result = cqe.res;
+				__atomic_store_n(cqHead, head + 1u, __ATOMIC_RELEASE);
+				inFlight--;
+				return completion;
+			}
+			const auto result = syscall(__NR_io_uring_enter, ringFd, unsubmitted, 1u, IORING_ENTER_GETEVENTS, nullptr, 0u);
+			if (result >= 0) {
+				unsubmitted -= static_cast<unsigned>(result);
+			} else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+				// Nothing queued can be told apart any more, so nor can it be finished
+				throw std::runtime_error("Failed to wait on io_uring");
+			}
+		}
+	}
+#endif
+	if (!done.empty()) {
+		completion = done.front();
+		done.erase(done.begin());
+		inFlight--;
+	}
+	return completion;
+}
@@ -0,0 +1,87 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+// Reads and writes at given file offsets, queued to an io_uring where the kernel's rings support them (Linux 5.6 or later),
+// and otherwise carried out synchronously as they're queued, so that callers needn't care which they got. Requests
+// may complete short, as pread and pwrite can. An instance isn't thread-safe; give each thread driving I/O its own.
+class AsyncIo {
+public:
+	struct Completion {
+		uint64_t tag = 0u;
+		ssize_t result = 0;	// The bytes transferred, or a negated errno
+	};
+
+	// At most depth requests may be in flight at once
+	explicit AsyncIo(unsigned depth);
+	AsyncIo(const AsyncIo&) = delete;
+	AsyncIo& operator=(const AsyncIo&) = delete;
+	~AsyncIo();
+
+	bool IsAsync() const { return ringFd >= 0; }
+	size_t InFlight() const { return inFlight; }
+	bool IsFull() const { return inFlight == depth; }
+
+	// The buffer must remain valid until the request has completed. False if the queue is full
+	bool Read(int fd, void *buffer, uint32_t length, uint64_t offset, uint64_t tag);
+	bool Write(int fd, const void *buffer, uint32_t length, uint64_t offset, uint64_t tag);
+	// Submits whatever has been queued, then waits for a request to complete. There must be one in flight.
+	// Throws std::runtime_error should the ring itself fail, since what was in flight can't then be accounted for
+	Completion Wait();
+
+private:
+	bool Queue(uint8_t opcode, int fd, uint64_t buffer, uint32_t length, uint64_t offset, uint64_t tag);
+
+	unsigned depth;
+	size_t inFlight = 0u;
+	unsigned unsubmitted = 0u;
+	int ringFd = -1;
+
+	// The ring's shared mappings, and where the kernel placed its fields within them
+	void *sqMapping = nullptr;
+	size_t sqMappingSize = 0u;
+	void *cqMapping = nullptr;
+	size_t cqMappingSize = 0u;
+	void *sqes = nullptr;
+	size_t sqesSize = 0u;
+	uint32_t *sqTail = nullptr;
+	uint32_t sqMask = 0u;
+	uint32_t *sqArray = nullptr;
+	uint32_t *cqHead = nullptr;
+	uint32_t *cqTail = nullptr;
+	uint32_t cqMask = 0u;
+	void *cqes = nullptr;
+
+	// Without a ring, requests are done as they're queued, and their results kept here until waited for
+	std::vector<Completion> done;
+};
+
+#endif
@@ -0,0 +1,340 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include "AsyncIo.h"
+#include "BatchConverter.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Requests are split so that their lengths fit io_uring's
+constexpr uint32_t MaxRequestLength = 1u << 30;
+
+struct Job {
+	std::string path;	// Relative to both directories
+	int fd = -1;
+	std::unique_ptr<uint8_t[]> input;
+	size_t inputSize = 0u;
+	std::vector<uint8_t> output;
+	size_t transferred = 0u;	// Of whichever of the input and output is being read or written
+
+	~Job() {
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+};
+
+// The bytes held by jobs in flight, against the limit on them
+class MemoryBudget {
+public:
+	explicit MemoryBudget(size_t limit_) : limit(limit_) { }
+
+	// Nothing is ever refused while nothing is held, so that any single file can go through
+	bool TryAcquire(size_t bytes) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (used && (used + bytes > limit)) {
+			return false;
+		}
+		used += bytes;
+		return true;
+	}
+
+	void Acquire(size_t bytes) {
+		std::unique_lock<std::mutex> lock(mutex);
+		released.wait(lock, [&] { return !used || (used + bytes <= limit); });
+		used += bytes;
+	}
+
+	void Add(size_t bytes) {
+		std::lock_guard<std::mutex> lock(mutex);
+		used += bytes;
+	}
+
+	void Release(size_t bytes) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			used -= bytes;
+		}
+		released.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable released;
+	size_t limit;
+	size_t used = 0u;
+};
+
+// Hands jobs from one stage of the pipeline to the next
+class JobQueue {
+public:
+	void Push(std::unique_ptr<Job> job) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(std::move(job));
+		}
+		ready.notify_one();
+	}
+
+	// Once closed, Pop returns false rather than waiting on an empty queue
+	void Close() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+		ready.notify_all();
+	}
+
+	bool Pop(std::unique_ptr<Job>& job) {
+		std::unique_lock<std::mutex> lock(mutex);
+		ready.wait(lock, [&] { return closed || !jobs.empty(); });
+		return Take(job);
+	}
+
+	bool TryPop(std::unique_ptr<Job>& job) {
+		std::lock_guard<std::mutex> lock(mutex);
+		return Take(job);
+	}
+
+private:
+	bool Take(std::unique_ptr<Job>& job) {
+		if (jobs.empty()) {
+			return false;
+		}
+		job = std::move(jobs.front());
+		jobs.pop_front();
+		return true;
+	}
+
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::deque<std::unique_ptr<Job>> jobs;
+	bool closed = false;
+};
+
+uint64_t Tag(Job *job) {
+	return reinterpret_cast<uintptr_t>(job);
+}
+
+std::unique_ptr<Job> Untag(uint64_t tag) {
+	return std::unique_ptr<Job>(reinterpret_cast<Job*>(static_cast<uintptr_t>(tag)));
+}
+
+}
+
+bool BatchConverter::Run(const std::string& inputDirectory, const std::string& outputDirectory, BatchStats& stats) {
+	const auto start = std::chrono::steady_clock::now();
+	stats = BatchStats();
+
+	// Listing everything first means that outputs written beneath the input directory are never taken as inputs
+	std::vector<std::string> paths;
+	std::error_code error;
+	for (fs::recursive_directory_iterator entry(inputDirectory, error), end; !error && (entry != end); entry.increment(error)) {
+		std::error_code entryError;
+		if (entry->is_directory(entryError) && fs::equivalent(entry->path(), outputDirectory, entryError)) {
+			entry.disable_recursion_pending();
+		} else if (entry->is_regular_file(entryError)) {
+			paths.push_back(entry->path().lexically_relative(inputDirectory).string());
+		}
+	}
+	if (error) {
+		return false;
+	}
+	std::sort(paths.begin(), paths.end());
+	stats.files = paths.size();
+
+	MemoryBudget budget(options.memoryLimit);
+	JobQueue converting;
+	JobQueue writing;
+	std::mutex failuresMutex;
+	const auto fail = [&](const Job& job, const char *reason) {
+		std::lock_guard<std::mutex> lock(failuresMutex);
+		stats.failures.push_back(job.path + ": " + reason);
+	};
+
+	std::thread reader([&] {
+		AsyncIo io(options.ioDepth);
+		stats.asyncIo = io.IsAsync();
+		const auto submit = [&](std::unique_ptr<Job> job) {
+			const auto length = std::min<size_t>(job->inputSize - job->transferred, MaxRequestLength);
+			io.Read(job->fd, job->input.get() + job->transferred, static_cast<uint32_t>(length), job->transferred, Tag(job.get()));
+			job.release();
+		};
+		size_t next = 0u;
+		std::unique_ptr<Job> pending;	// Opened, and waiting on the budget
+		for (;;) {
+			while (!io.IsFull()) {
+				if (!pending) {
+					if (next == paths.size()) {
+						break;
+					}
+					pending.reset(new Job);
+					pending->path = paths[next++];
+					pending->fd = open((fs::path(inputDirectory) / pending->path).c_str(), O_RDONLY);
+					struct stat st;
+					if ((pending->fd < 0) || (fstat(pending->fd, &st) != 0)) {
+						fail(*pending, strerror(errno));
+						pending.reset();
+						continue;
+					}
+					pending->inputSize = static_cast<size_t>(st.st_size);
+				}
+				// Waiting here with reads in flight would leave their completions, and so the budget, stuck
+				if (!budget.TryAcquire(pending->inputSize)) {
+					if (io.InFlight()) {
+						break;
+					}
+					budget.Acquire(pending->inputSize);
+				}
+				pending->input.reset(new uint8_t[pending->inputSize]);
+				if (pending->inputSize) {
+					submit(std::move(pending));
+				} else {
+					converting.Push(std::move(pending));
+				}
+			}
+			if (!io.InFlight()) {
+				break;
+			}
+			const auto completion = io.Wait();
+			auto job = Untag(completion.tag);
+			if (completion.result <= 0) {
+				fail(*job, completion.result ? strerror(static_cast<int>(-completion.result)) : "File shrank while being read");
+				budget.Release(job->inputSize);
+				continue;
+			}
+			job->transferred += static_cast<size_t>(completion.result);
+			if (job->transferred < job->inputSize) {
+				submit(std::move(job));
+				continue;
+			}
+			close(job->fd);
+			job->fd = -1;
+			converting.Push(std::move(job));
+		}
+		converting.Close();
+	});
+
+	std::vector<std::thread> converters;
+	for (auto threadIdx = 0u; threadIdx < std::max(options.convertThreads, 1u); threadIdx++) {
+		converters.emplace_back([&] {
+			std::unique_ptr<Job> job;
+			while (converting.Pop(job)) {
+				auto converted = false;
+				try {
+					converted = convert(job->input.get(), job->inputSize, job->output);
+					if (!converted) {
+						fail(*job, "Couldn't be converted");
+					}
+				} catch (const std::exception& e) {
+					fail(*job, e.what());
+				}
+				if (!converted) {
+					job->output.clear();
+				}
+				// The output is counted before the input is let go, so the budget never looks emptier than it is
+				budget.Add(job->output.size());
+				budget.Release(job->inputSize);
+				job->input.reset();
+				if (converted) {
+					job->transferred = 0u;
+					writing.Push(std::move(job));
+				}
+			}
+		});
+	}
+
+	std::thread writer([&] {
+		AsyncIo io(options.ioDepth);
+		const auto submit = [&](std::unique_ptr<Job> job) {
+			const auto length = std::min<size_t>(job->output.size() - job->transferred, MaxRequestLength);
+			io.Write(job->fd, job->output.data() + job->transferred, static_cast<uint32_t>(length), job->transferred, Tag(job.get()));
+			job.release();
+		};
+		const auto finish = [&](std::unique_ptr<Job> job) {
+			stats.inputBytes += job->inputSize;
+			stats.outputBytes += job->output.size();
+			budget.Release(job->output.size());
+		};
+		for (;;) {
+			std::unique_ptr<Job> next;
+			while (!io.IsFull() && (io.InFlight() ? writing.TryPop(next) : writing.Pop(next))) {
+				const auto path = fs::path(outputDirectory) / next->path;
+				std::error_code directoryError;
+				fs::create_directories(path.parent_path(), directoryError);
+				next->fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+				if (next->fd < 0) {
+					fail(*next, strerror(errno));
+					budget.Release(next->output.size());
+				} else if (next->output.empty()) {
+					finish(std::move(next));
+				} else {
+					submit(std::move(next));
+				}
+			}
+			if (!io.InFlight()) {
+				break;
+			}
+			const auto completion = io.Wait();
+			auto job = Untag(completion.tag);
+			if (completion.result <= 0) {
+				fail(*job, completion.result ? strerror(static_cast<int>(-completion.result)) : "Nothing could be written");
+				unlink((fs::path(outputDirectory) / job->path).c_str());
+				budget.Release(job->output.size());
+				continue;
+			}
+			job->transferred += static_cast<size_t>(completion.result);
+			if (job->transferred < job->output.size()) {
+				submit(std::move(job));
+			} else {
+				finish(std::move(job));
+			}
+		}
+	});
+
+	reader.join();
+	for (auto& converter : converters) {
+		converter.join();
+	}
+	writing.Close();
+	writer.join();
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
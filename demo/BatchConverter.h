@@ -0,0 +1,73 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#ifndef BATCHCONVERTER_H
+#define BATCHCONVERTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BatchOptions {
+	unsigned convertThreads = 1u;
+	// Input and output bytes held between a file's read starting and its write completing. No new read starts
+	// while this is exceeded, although a file larger than the whole budget is still converted, on its own.
+	// Converting threads never wait on the budget, so it can be overrun by what they have in hand.
+	size_t memoryLimit = 256u << 20;
+	// Requests in flight at once, for reads and again for writes
+	unsigned ioDepth = 32u;
+};
+
+struct BatchStats {
+	size_t files = 0u;
+	std::vector<std::string> failures;	// Each failed file's path, and why it failed
+	uint64_t inputBytes = 0u;	// Of the files converted successfully
+	uint64_t outputBytes = 0u;
+	double seconds = 0.0;
+	bool asyncIo = false;	// Whether I/O went through io_uring, rather than being carried out synchronously
+};
+
+// Converts every regular file under one directory into a file at the same relative path under another, as a
+// pipeline: one thread reads files in while others convert them and a third writes the results out, each stage
+// overlapping the rest. The converter is called concurrently, and may fail a file, which is then recorded and
+// skipped. Output files are replaced wherever they exist already.
+class BatchConverter {
+public:
+	using Convert = std::function<bool(const uint8_t *input, size_t size, std::vector<uint8_t>& output)>;
+
+	BatchConverter(Convert convert_, const BatchOptions& options_ = BatchOptions()) :
+			convert(std::move(convert_)), options(options_) { }
+
+	// False if the input directory can't be listed; failures of individual files are only counted
+	bool Run(const std::string& inputDirectory, const std::string& outputDirectory, BatchStats& stats);
+
+private:
+	Convert convert;
+	BatchOptions options;
+};
+
+#endif
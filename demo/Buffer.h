@@ -46,6 +46,8 @@ struct Buffer {
 
 	explicit Buffer(const std::vector<uint8_t>& bytes) : bytes(bytes) { }
 
+	Buffer(const uint8_t *bytes_, size_t length) : bytes(bytes_, bytes_ + length) { }
+
 	Buffer(const std::vector<uint8_t>& bytes_, size_t offset, size_t length) {
 		bytes.insert(bytes.end(), bytes_.begin() + offset, bytes_.begin() + offset + length);
 	}
@@ -207,6 +209,13 @@ struct Buffer {
 		return bytes[offset] | ((uint32_t)bytes[offset + 1] << 8) | ((uint32_t)bytes[offset + 2] << 16) | ((uint32_t)bytes[offset + 3] << 24);
 	}
 
+	uint32_t ReadU32BE() {
+		AssertRemainingBytes(4);
+		const uint32_t data = ((uint32_t)bytes[readCursor] << 24) | ((uint32_t)bytes[readCursor + 1] << 16) | ((uint32_t)bytes[readCursor + 2] << 8) | bytes[readCursor + 3];
+		readCursor += 4;
+		return data;
+	}
+
 	int64_t ReadS64() {
 		AssertRemainingBytes(8);
 		const uint64_t data = bytes[readCursor] | ((uint32_t)bytes[readCursor + 1] << 8) | ((uint32_t)bytes[readCursor + 2] << 16) | ((uint32_t)bytes[readCursor + 3] << 24) |
@@ -229,6 +238,11 @@ struct Buffer {
 				((uint64_t)bytes[offset + 4] << 32) | ((uint64_t)bytes[offset + 5] << 40) | ((uint64_t)bytes[offset + 6] << 48) | ((uint64_t)bytes[offset + 7] << 56);
 	}
 
+	uint64_t ReadU64BE() {
+		const uint64_t high = ReadU32BE();
+		return (high << 32) | ReadU32BE();
+	}
+
 	float ReadFloat() {
 		AssertRemainingBytes(4);
 		float data = *(const float*)&bytes[readCursor];
@@ -303,6 +317,11 @@ struct Buffer {
 		AppendU8(value);
 	}
 
+	void AppendU64BE(uint64_t value) {
+		AppendU32BE(value >> 32);
+		AppendU32BE(value);
+	}
+
 	void AppendFloat(float value) {
 		const auto offset = bytes.size();
 		bytes.push_back(0);
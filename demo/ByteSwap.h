@@ -0,0 +1,119 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#ifndef BYTESWAP_H
+#define BYTESWAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Reverses the bytes of runs of 2, 4 or 8-byte elements in place, 16 bytes at a time where the target has
+// vectors, for converting a file's data to the host's byte order
+struct ByteSwap {
+	// Returns false for any other element size; 1-byte elements are left as they are
+	static bool Swap(uint8_t *data, size_t count, uint32_t elementSize) {
+		switch (elementSize) {
+			case 1u: return true;
+			case 2u: Swap16(data, count); return true;
+			case 4u: Swap32(data, count); return true;
+			case 8u: Swap64(data, count); return true;
+			default: return false;
+		}
+	}
+
+	static void Swap16(uint8_t *data, size_t count) {
+		const auto end = data + (count * 2u);
+#if defined(__SSE2__)
+		for (; (end - data) >= 16; data += 16) {
+			Store(data, Swap16(Load(data)));
+		}
+#elif defined(__ARM_NEON)
+		for (; (end - data) >= 16; data += 16) {
+			vst1q_u8(data, vrev16q_u8(vld1q_u8(data)));
+		}
+#endif
+		for (; data < end; data += 2) {
+			uint16_t value;
+			std::memcpy(&value, data, sizeof(value));
+			value = __builtin_bswap16(value);
+			std::memcpy(data, &value, sizeof(value));
+		}
+	}
+
+	static void Swap32(uint8_t *data, size_t count) {
+		const auto end = data + (count * 4u);
+#if defined(__SSE2__)
+		for (; (end - data) >= 16; data += 16) {
+			// Swap the halves of each word, then the bytes of each half
+			const auto halves = _mm_shufflehi_epi16(_mm_shufflelo_epi16(Load(data), 0xB1), 0xB1);
+			Store(data, Swap16(halves));
+		}
+#elif defined(__ARM_NEON)
+		for (; (end - data) >= 16; data += 16) {
+			vst1q_u8(data, vrev32q_u8(vld1q_u8(data)));
+		}
+#endif
+		for (; data < end; data += 4) {
+			uint32_t value;
+			std::memcpy(&value, data, sizeof(value));
+			value = __builtin_bswap32(value);
+			std::memcpy(data, &value, sizeof(value));
+		}
+	}
+
+	static void Swap64(uint8_t *data, size_t count) {
+		const auto end = data + (count * 8u);
+#if defined(__SSE2__)
+		for (; (end - data) >= 16; data += 16) {
+			const auto quarters = _mm_shufflehi_epi16(_mm_shufflelo_epi16(Load(data), 0x1B), 0x1B);
+			Store(data, Swap16(quarters));
+		}
+#elif defined(__ARM_NEON)
+		for (; (end - data) >= 16; data += 16) {
+			vst1q_u8(data, vrev64q_u8(vld1q_u8(data)));
+		}
+#endif
+		for (; data < end; data += 8) {
+			uint64_t value;
+			std::memcpy(&value, data, sizeof(value));
+			value = __builtin_bswap64(value);
+			std::memcpy(data, &value, sizeof(value));
+		}
+	}
+
+private:
+#if defined(__SSE2__)
+	static __m128i Load(const uint8_t *data) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)); }
+	static void Store(uint8_t *data, __m128i value) { _mm_storeu_si128(reinterpret_cast<__m128i*>(data), value); }
+	static __m128i Swap16(__m128i value) { return _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8)); }
+#endif
+};
+
+#endif
@@ -0,0 +1,117 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// The common (zlib / PNG) CRC-32, as Granny files use for their contents. Hardware CRC instructions compute
+// CRC-32C instead, so this uses slice-by-8 tables, and CRCs of separate chunks can be combined afterwards
+struct Crc32 {
+	static constexpr uint32_t Polynomial = 0xEDB88320u;
+	static constexpr auto Slices = 8u;
+
+	using Table = std::array<std::array<uint32_t,256>,Slices>;
+
+	static constexpr Table MakeTable() {
+		Table table = { { { 0 } } };
+		for (auto idx = 0u; idx < 256u; idx++) {
+			auto value = idx;
+			for (auto bit = 0u; bit < 8u; bit++) {
+				value = (value >> 1) ^ ((value & 1u) ? Polynomial : 0u);
+			}
+			table[0][idx] = value;
+		}
+		// Each further slice advances the CRC by another zero byte
+		for (auto slice = 1u; slice < Slices; slice++) {
+			for (auto idx = 0u; idx < 256u; idx++) {
+				const auto value = table[slice - 1][idx];
+				table[slice][idx] = (value >> 8) ^ table[0][value & 0xFF];
+			}
+		}
+		return table;
+	}
+
+	// Continues a CRC from a previous call, or starts one from 0
+	static uint32_t Update(const uint8_t *bytes, size_t length, uint32_t crc = 0u) {
+		static constexpr auto table = MakeTable();
+		crc = ~crc;
+		for (; length >= Slices; bytes += Slices, length -= Slices) {
+			const auto lo = crc ^ LoadU32(bytes);
+			const auto hi = LoadU32(bytes + 4);
+			crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+					table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+		}
+		for (; length > 0u; bytes++, length--) {
+			crc = table[0][(crc ^ *bytes) & 0xFF] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	// The CRC of two chunks back to back, from each chunk's own CRC, and the second chunk's length
+	static uint32_t Combine(uint32_t first, uint32_t second, size_t secondLength);
+
+private:
+	static uint32_t LoadU32(const uint8_t *bytes) {
+		return bytes[0] | (static_cast<uint32_t>(bytes[1]) << 8) | (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+	}
+
+	// Polynomials modulo Polynomial, bit-reflected as the CRC is, so that x^0 is the top bit
+	static constexpr uint32_t Multiply(uint32_t lhs, uint32_t rhs) {
+		uint32_t product = 0u;
+		for (auto bit = 1u << 31; bit != 0u; bit >>= 1) {
+			if (lhs & bit) {
+				product ^= rhs;
+			}
+			rhs = (rhs & 1u) ? ((rhs >> 1) ^ Polynomial) : (rhs >> 1);
+		}
+		return product;
+	}
+
+	// x^(2^n), for each n
+	static constexpr std::array<uint32_t,32> MakePowers() {
+		std::array<uint32_t,32> powers = { 1u << 30 };
+		for (auto idx = 1u; idx < powers.size(); idx++) {
+			powers[idx] = Multiply(powers[idx - 1], powers[idx - 1]);
+		}
+		return powers;
+	}
+};
+
+inline uint32_t Crc32::Combine(uint32_t first, uint32_t second, size_t secondLength) {
+	static constexpr auto powers = MakePowers();
+	// Multiply the first CRC by x^(8 * secondLength), one power of two at a time
+	auto shift = 1u << 31;
+	for (auto powerIdx = 3u; secondLength > 0u; secondLength >>= 1, powerIdx++) {
+		if (secondLength & 1u) {
+			shift = Multiply(powers[powerIdx & 31], shift);
+		}
+	}
+	return Multiply(shift, first) ^ second;
+}
+
+#endif
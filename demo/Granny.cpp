@@ -22,136 +22,663 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 //
 // For more information, please refer to <https://unlicense.org>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <iostream>
-#include <oodle/Oodle1.h>
+#include <numeric>
+#include <thread>
 #include "Granny.h"
 #include "Buffer.h"
+#include "ByteSwap.h"
+#include "Crc32.h"
 #include "Format.h"
 
-bool GrannySectionHeader::Load(Buffer& buffer, uint32_t totalFileSize) {
-	encoding = (Encoding)buffer.ReadU32();
-	fileOffset = buffer.ReadU32();
-	fileSize = buffer.ReadU32();
-	memSize = buffer.ReadU32();
-	alignment = buffer.ReadU32();
-	stream0Stop = buffer.ReadU32();
-	stream1Stop = buffer.ReadU32();
-	relocOffset = buffer.ReadU32();
-	relocCount = buffer.ReadU32();
-	marshalOffset = buffer.ReadU32();
-	marshalCount = buffer.ReadU32();
-	if ((fileOffset > totalFileSize) || ((fileOffset + fileSize) > totalFileSize)) {
+// Everything after the signature is in the file's byte order
+static uint32_t ReadU32(Buffer& buffer, bool bigEndian) {
+	return bigEndian ? buffer.ReadU32BE() : buffer.ReadU32();
+}
+
+static uint64_t ReadU64(Buffer& buffer, bool bigEndian) {
+	return bigEndian ? buffer.ReadU64BE() : buffer.ReadU64();
+}
+
+bool GrannySectionHeader::Load(Buffer& buffer, uint32_t totalFileSize, bool bigEndian) {
+	encoding = (Encoding)ReadU32(buffer, bigEndian);
+	fileOffset = ReadU32(buffer, bigEndian);
+	fileSize = ReadU32(buffer, bigEndian);
+	memSize = ReadU32(buffer, bigEndian);
+	alignment = ReadU32(buffer, bigEndian);
+	stream0Stop = ReadU32(buffer, bigEndian);
+	stream1Stop = ReadU32(buffer, bigEndian);
+	relocOffset = ReadU32(buffer, bigEndian);
+	relocCount = ReadU32(buffer, bigEndian);
+	marshalOffset = ReadU32(buffer, bigEndian);
+	marshalCount = ReadU32(buffer, bigEndian);
+	if ((fileOffset > totalFileSize) || ((static_cast<uint64_t>(fileOffset) + fileSize) > totalFileSize)) {
 		std::cerr << Formatted("Granny section file offset / size are invalid (%08x + %x)", fileOffset, fileSize) << std::endl;
 		return false;
 	} else if (memSize < fileSize) {
 		std::cerr << Formatted("Granny section memory size (%x) is invalid", memSize) << std::endl;
 		return false;
-	} else if ((relocOffset > totalFileSize) || ((relocOffset + (relocCount * 12)) > totalFileSize)) {
-		std::cerr << Formatted("Granny2 section relocation table offset / size are invalid (%08x + %d entries)", relocOffset, relocCount) << std::endl;
+	} else if ((alignment > GrannyFile::MaxSectionAlignment) || (alignment & (alignment - 1))) {
+		std::cerr << Formatted("Granny section alignment (%x) is invalid", alignment) << std::endl;
 		return false;
-	} else if ((marshalOffset > totalFileSize) || ((marshalOffset + (marshalCount * 12)) > totalFileSize)) {
+	} else if ((relocOffset > totalFileSize) || ((relocOffset + (static_cast<uint64_t>(relocCount) * GrannyFile::RelocationSize)) > totalFileSize)) {
 		std::cerr << Formatted("Granny2 section relocation table offset / size are invalid (%08x + %d entries)", relocOffset, relocCount) << std::endl;
 		return false;
-	} else if (marshalCount > 0) {
-		std::cerr << Formatted("Granny2 section has %d marshal headers, which are unsupported", marshalCount) << std::endl;
+	} else if ((marshalOffset > totalFileSize) || ((marshalOffset + (static_cast<uint64_t>(marshalCount) * GrannyFile::MarshallingSize)) > totalFileSize)) {
+		std::cerr << Formatted("Granny2 section marshalling table offset / size are invalid (%08x + %d entries)", marshalOffset, marshalCount) << std::endl;
 		return false;
 	}
 	return true;
 }
 
 
-bool GrannyFile::LoadFromBytes(const std::vector<uint8_t>& raw) {
-	if (raw.size() < 64) {
+bool GrannyFile::LoadHeaders(const uint8_t *raw, size_t size) {
+	if (size < 64) {
 		std::cerr << "Granny file is implausibly small" << std::endl;
 		return false;
 	}
-	Buffer buffer(raw);
+	data = nullptr;
+	cachedData.Reset();
+	crcChecked = false;
+	crcMatched = false;
+	dataAlignment = 1u;
+	dataCapacity = 0u;
+	dataSize = 0u;
+	fileData = raw;
+	marshalling.clear();
+	marshallingStarts.clear();
+	ownedData.reset();
+	relocations.clear();
+	relocationStarts.clear();
+	sectionHeaders.clear();
+	sectionMemOffsets.clear();
+	sectionStats.clear();
+	streamStarts.clear();
+	residentSections.clear();
+	residentBytes = 0u;
+	// Only the headers are copied; sections are decompressed straight from the raw bytes
+	Buffer buffer(raw, std::min<size_t>(size, PrimaryHeaderSize));
 	std::array<uint8_t,SignatureLength> signature;
 	buffer.Read(signature);
-	if (signature != SignatureLE) {
+	if ((signature != SignatureLE) && (signature != SignatureBE)) {
 		std::cerr << "Granny file has invalid magic bytes" << std::endl;
 		return false;
 	}
-	totalHeaderSize = buffer.ReadU32();
+	bigEndian = (signature == SignatureBE);
+	totalHeaderSize = ReadU32(buffer, bigEndian);
 	buffer.ReadPadding(12);
 	dataBase = buffer.Tell();	// This point appears to mark the end of one kind of header, and the beginning of another?
-	version = buffer.ReadU32();
+	version = ReadU32(buffer, bigEndian);
 	if (version != 6) {
 		std::cerr << Formatted("Granny file has unsupported version %d", version) << std::endl;
 		return false;
 	}
-	totalFileSize = buffer.ReadU32();
-	if (totalFileSize != buffer.Size()) {
-		std::cerr << Formatted("Granny file claims length %d, but is actually %d", totalFileSize, buffer.Size()) << std::endl;
+	totalFileSize = ReadU32(buffer, bigEndian);
+	if (totalFileSize != size) {
+		std::cerr << Formatted("Granny file claims length %u, but is actually %zu", totalFileSize, size) << std::endl;
 		return false;
 	}
-	crc = buffer.ReadU32();
-	const auto sectionHdrOffset = buffer.ReadU32() + dataBase;
-	const auto sectionCount = buffer.ReadU32();
-	rootNodeType = buffer.ReadU64();
-	rootNodeObject = buffer.ReadU64();
-	userTag = buffer.ReadU32();
+	crc = ReadU32(buffer, bigEndian);
+	const auto sectionHdrOffset = ReadU32(buffer, bigEndian) + dataBase;
+	const auto sectionCount = ReadU32(buffer, bigEndian);
+	rootNodeType = ReadU64(buffer, bigEndian);
+	rootNodeObject = ReadU64(buffer, bigEndian);
+	userTag = ReadU32(buffer, bigEndian);
 	buffer.Read(userData);
 
-	if ((sectionHdrOffset < buffer.Tell()) || (sectionHdrOffset >= totalFileSize) || ((sectionHdrOffset + (sectionCount * SectionHeaderSize)) > totalFileSize)) {
+	const auto sectionHdrEnd = sectionHdrOffset + (static_cast<uint64_t>(sectionCount) * SectionHeaderSize);
+	if ((sectionHdrOffset < buffer.Tell()) || (sectionHdrOffset >= totalFileSize) || (sectionHdrEnd > totalFileSize)) {
 		std::cerr << Formatted("Granny file has invalid section-header offset / count %x + %d", sectionHdrOffset, sectionCount) << std::endl;
 		return false;
-	} else if (totalHeaderSize < (sectionHdrOffset + (sectionCount * SectionHeaderSize))) {
+	} else if (totalHeaderSize < sectionHdrEnd) {
 		std::cerr << "Granny file has invalid total header size" << std::endl;
 		return false;
 	}
 
-	auto totalMemSize = 0u;
+	crcStart = sectionHdrOffset;
+
+	buffer = Buffer(raw, static_cast<size_t>(sectionHdrEnd));
 	buffer.Seek(sectionHdrOffset);
 	for (auto sectionIdx = 0u; sectionIdx < sectionCount; sectionIdx++) {
 		GrannySectionHeader hdr;
-		if (!hdr.Load(buffer, totalFileSize)) {
+		if (!hdr.Load(buffer, totalFileSize, bigEndian)) {
 			return false;
 		}
 		sectionHeaders.push_back(hdr);
-		totalMemSize += sectionHeaders.back().memSize;
+		// Every section's output offset is known up front, so they may be decoded (and relocated) in any order
+		const auto alignment = std::max<size_t>(hdr.alignment, 1u);
+		dataSize = (dataSize + alignment - 1) & ~(alignment - 1);
+		dataAlignment = std::max(dataAlignment, alignment);
+		sectionMemOffsets.push_back(dataSize);
+		dataSize += hdr.memSize;
+	}
+	if (!LoadFixups(raw)) {
+		return false;
 	}
+	streamStarts.assign(sectionCount, GrannyStreamStarts());
+	sectionStats.resize(sectionCount);
+	residentSections.resize(sectionCount);
+	return true;
+}
 
-	data.resize(totalMemSize);
-	auto memOffset = 0u;
-	for (const auto& secHdr : sectionHeaders) {
-		if (secHdr.memSize <= 0u) {
-			continue;
-		}
-		buffer.Seek(secHdr.fileOffset);
-		switch (secHdr.encoding) {
-			case GrannySectionHeader::Encoding::Raw:
-				buffer.Read(&data[memOffset], secHdr.fileSize);
-				break;
-			case GrannySectionHeader::Encoding::Oodle1: {
-				DecompressOodle1(secHdr, buffer.Data() + secHdr.fileOffset, &data[memOffset]);
-				break;
+bool GrannyFile::LoadFixups(const uint8_t *raw) {
+	const auto sectionCount = static_cast<uint32_t>(sectionHeaders.size());
+	for (auto sectionIdx = 0u; sectionIdx < sectionCount; sectionIdx++) {
+		const auto& secHdr = sectionHeaders[sectionIdx];
+		marshallingStarts.push_back(marshalling.size());
+		Buffer marshalBuffer(raw + secHdr.marshalOffset, secHdr.marshalCount * MarshallingSize);
+		for (auto marshalIdx = 0u; marshalIdx < secHdr.marshalCount; marshalIdx++) {
+			GrannyMarshalling marshal;
+			marshal.offset = ReadU32(marshalBuffer, bigEndian);
+			marshal.count = ReadU32(marshalBuffer, bigEndian);
+			marshal.elementSize = ReadU32(marshalBuffer, bigEndian);
+			if ((marshal.elementSize > 8u) || (marshal.elementSize & (marshal.elementSize - 1))) {
+				std::cerr << Formatted("Granny section %d marshalling %d has unsupported element size %d", sectionIdx, marshalIdx, marshal.elementSize) << std::endl;
+				return false;
+			} else if ((marshal.offset + (static_cast<uint64_t>(marshal.count) * marshal.elementSize)) > secHdr.memSize) {
+				std::cerr << Formatted("Granny section %d marshalling %d lies beyond the section (%x + %d elements)", sectionIdx, marshalIdx, marshal.offset, marshal.count) << std::endl;
+				return false;
 			}
-			case GrannySectionHeader::Encoding::Oodle0:
-			default:
-				std::cerr << Formatted("Granny section uses unsupported encoding %d", secHdr.encoding) << std::endl;
+			marshalling.push_back(marshal);
+		}
+
+		relocationStarts.push_back(relocations.size());
+		Buffer buffer(raw + secHdr.relocOffset, secHdr.relocCount * RelocationSize);
+		for (auto relocIdx = 0u; relocIdx < secHdr.relocCount; relocIdx++) {
+			GrannyRelocation reloc;
+			reloc.offset = ReadU32(buffer, bigEndian);
+			reloc.targetSection = ReadU32(buffer, bigEndian);
+			reloc.targetOffset = ReadU32(buffer, bigEndian);
+			if ((reloc.offset > secHdr.memSize) || ((secHdr.memSize - reloc.offset) < PointerSize)) {
+				std::cerr << Formatted("Granny section %d relocation %d lies beyond the section (%x)", sectionIdx, relocIdx, reloc.offset) << std::endl;
+				return false;
+			} else if ((reloc.targetSection >= sectionCount) || (reloc.targetOffset > sectionHeaders[reloc.targetSection].memSize)) {
+				std::cerr << Formatted("Granny section %d relocation %d targets an invalid location (section %d + %x)", sectionIdx, relocIdx, reloc.targetSection, reloc.targetOffset) << std::endl;
 				return false;
+			}
+			relocations.push_back(reloc);
+		}
+	}
+	marshallingStarts.push_back(marshalling.size());
+	relocationStarts.push_back(relocations.size());
+	return true;
+}
+
+bool GrannyFile::Decompress(const GrannyLoadOptions& options) {
+	if (CanCache(options) && fileData && dataSize) {
+		GrannyCache::Entry entry;
+		if (options.cache->Find(CacheKey(GrannyCache::WholeFile, options.relocation), dataSize, dataAlignment, entry)) {
+			ownedData.reset();
+			cachedData = std::move(entry);
+			// The mapping is read-only, but nothing writes to the data once it's been loaded
+			data = const_cast<uint8_t*>(cachedData.GetData());
+			dataCapacity = dataSize;
+			return !options.verifyCrc || CrcMatches();
+		}
+	}
+	// The extra bytes let the final section be decoded with repeat slack too, and let the data be aligned
+	const auto outputSize = dataSize + Oodle::Oodle1Decompressor::RepeatSlack;
+	ownedData.reset(new uint8_t[outputSize + dataAlignment - 1]);
+	const auto misalignment = reinterpret_cast<uintptr_t>(ownedData.get()) & (dataAlignment - 1);
+	const auto output = ownedData.get() + (misalignment ? (dataAlignment - misalignment) : 0u);
+	// The cache has just been probed for this file, so it isn't probed again
+	return DecompressInto(output, outputSize, options, false);
+}
+
+bool GrannyFile::Decompress(uint8_t *output, size_t outputSize, const GrannyLoadOptions& options) {
+	return DecompressInto(output, outputSize, options, true);
+}
+
+bool GrannyFile::DecompressInto(uint8_t *output, size_t outputSize, const GrannyLoadOptions& options, bool probeCache) {
+	if (outputSize < dataSize) {
+		std::cerr << Formatted("Granny file needs %zx bytes of output, but only %zx were given", dataSize, outputSize) << std::endl;
+		return false;
+	} else if (!fileData) {
+		std::cerr << "Granny file headers must be loaded before decompressing" << std::endl;
+		return false;
+	}
+	cachedData.Reset();
+	data = output;
+	dataCapacity = outputSize;
+	if (probeCache && CanCache(options) && dataSize) {
+		GrannyCache::Entry entry;
+		if (options.cache->Find(CacheKey(GrannyCache::WholeFile, options.relocation), dataSize, 1u, entry)) {
+			std::memcpy(output, entry.GetData(), dataSize);
+			return !options.verifyCrc || CrcMatches();
+		}
+	}
+	if (!DecodeSections(options)) {
+		return false;
+	}
+	// Only data whose CRC matched is cached, so that a damaged copy of a file can never stand in for it later
+	if (CanCache(options) && dataSize && CrcMatches()) {
+		options.cache->Store(CacheKey(GrannyCache::WholeFile, options.relocation), data, dataSize);
+	}
+	return true;
+}
+
+bool GrannyFile::DecodeSections(const GrannyLoadOptions& options) {
+	const auto sectionCount = static_cast<uint32_t>(sectionHeaders.size());
+	const auto threadCount = std::min<size_t>(std::max(options.sectionThreads, 1u), sectionCount);
+	// Each chunk's CRC is taken separately, and they're only combined once every thread is done
+	std::vector<uint32_t> chunkCrcs(options.verifyCrc ? GetCrcChunkCount() : 0u);
+	if (threadCount <= 1u) {
+		std::thread checker;
+		if (!chunkCrcs.empty()) {
+			checker = std::thread([&]() {
+				for (size_t chunkIdx = 0u; chunkIdx < chunkCrcs.size(); chunkIdx++) {
+					chunkCrcs[chunkIdx] = GetCrcChunk(chunkIdx);
+				}
+			});
+		}
+		// Decompressors are re-initialized in place for every Oodle1 stream in the file; only the
+		// parallel stream mode needs more than the first
+		Decompressors decomps;
+		auto loaded = true;
+		for (auto sectionIdx = 0u; loaded && (sectionIdx < sectionCount); sectionIdx++) {
+			// Any later section's bytes may be used as slack, since they're written afterwards
+			const auto outputSlack = dataCapacity - (sectionMemOffsets[sectionIdx] + sectionHeaders[sectionIdx].memSize);
+			loaded = LoadSection(decomps, sectionIdx, &data[sectionMemOffsets[sectionIdx]], outputSlack, options);
+			ClearPadding(sectionIdx);
+		}
+		if (checker.joinable()) {
+			checker.join();
+		}
+		return loaded && CheckDecodedCrc(chunkCrcs);
+	}
+
+	// Workers take sections largest-first from a shared queue, so the longest decodes start
+	// earliest and the small ones fill in around them. Any CRC chunks come last, to fill in the gaps.
+	std::vector<uint32_t> order(sectionCount);
+	std::iota(order.begin(), order.end(), 0u);
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs) {
+		return sectionHeaders[lhs].memSize > sectionHeaders[rhs].memSize;
+	});
+	std::atomic<size_t> nextOrderIdx(0u);
+	std::atomic<bool> failed(false);
+	const auto worker = [&]() {
+		Decompressors decomps;
+		while (!failed) {
+			const auto orderIdx = nextOrderIdx++;
+			if (orderIdx >= order.size()) {
+				if ((orderIdx - order.size()) >= chunkCrcs.size()) {
+					break;
+				}
+				chunkCrcs[orderIdx - order.size()] = GetCrcChunk(orderIdx - order.size());
+				continue;
+			}
+			// Neighbouring sections may be in flight on other threads, so there's never any slack
+			const auto sectionIdx = order[orderIdx];
+			if (!LoadSection(decomps, sectionIdx, &data[sectionMemOffsets[sectionIdx]], 0u, options)) {
+				failed = true;
+			}
+			ClearPadding(sectionIdx);
+		}
+	};
+	std::vector<std::thread> workers;
+	for (auto threadIdx = 1u; threadIdx < threadCount; threadIdx++) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto& thread : workers) {
+		thread.join();
+	}
+	return !failed && CheckDecodedCrc(chunkCrcs);
+}
+
+bool GrannyFile::VerifyCrc() const {
+	if (!fileData) {
+		std::cerr << "Granny file headers must be loaded before verifying" << std::endl;
+		return false;
+	}
+	std::vector<uint32_t> chunkCrcs(GetCrcChunkCount());
+	for (size_t chunkIdx = 0u; chunkIdx < chunkCrcs.size(); chunkIdx++) {
+		chunkCrcs[chunkIdx] = GetCrcChunk(chunkIdx);
+	}
+	return CheckCrc(chunkCrcs);
+}
+
+uint32_t GrannyFile::GetCrcChunk(size_t chunkIdx) const {
+	const auto chunkStart = crcStart + (chunkIdx * CrcChunkSize);
+	return Crc32::Update(&fileData[chunkStart], std::min<size_t>(CrcChunkSize, totalFileSize - chunkStart));
+}
+
+bool GrannyFile::CheckCrc(const std::vector<uint32_t>& chunkCrcs) const {
+	if (chunkCrcs.empty()) {
+		// Verification wasn't asked for
+		return true;
+	}
+	auto fileCrc = chunkCrcs[0];
+	auto chunkStart = crcStart + CrcChunkSize;
+	for (size_t chunkIdx = 1u; chunkIdx < chunkCrcs.size(); chunkIdx++, chunkStart += CrcChunkSize) {
+		fileCrc = Crc32::Combine(fileCrc, chunkCrcs[chunkIdx], std::min<size_t>(CrcChunkSize, totalFileSize - chunkStart));
+	}
+	if (fileCrc != crc) {
+		std::cerr << Formatted("Granny file CRC (%08x) doesn't match its contents (%08x)", crc, fileCrc) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// A CRC taken while decoding is remembered, so that caching the data doesn't take it again
+bool GrannyFile::CheckDecodedCrc(const std::vector<uint32_t>& chunkCrcs) {
+	if (chunkCrcs.empty()) {
+		return true;
+	}
+	crcMatched = CheckCrc(chunkCrcs);
+	crcChecked = true;
+	return crcMatched;
+}
+
+bool GrannyFile::CrcMatches() {
+	if (!crcChecked) {
+		crcMatched = VerifyCrc();
+		crcChecked = true;
+	}
+	return crcMatched;
+}
+
+GrannyCache::Key GrannyFile::CacheKey(uint32_t sectionIdx, GrannyRelocationMode mode) const {
+	GrannyCache::Key key;
+	key.crc = crc;
+	key.fileSize = totalFileSize;
+	key.section = sectionIdx;
+	key.relocation = mode;
+	return key;
+}
+
+const uint8_t *GrannyFile::GetSection(uint32_t sectionIdx) {
+	if (sectionIdx >= sectionHeaders.size()) {
+		std::cerr << Formatted("Granny file has no section %d", sectionIdx) << std::endl;
+		return nullptr;
+	} else if (data) {
+		return &data[sectionMemOffsets[sectionIdx]];
+	}
+	const auto& secHdr = sectionHeaders[sectionIdx];
+	if ((secHdr.memSize == 0u) || ((secHdr.encoding == GrannySectionHeader::Encoding::Raw) && (secHdr.memSize == secHdr.fileSize) && !NeedsMarshalling(sectionIdx))) {
+		// Nothing needs decompressing or swapping, so the raw bytes are used as they are
+		return fileData + secHdr.fileOffset;
+	}
+	auto& resident = residentSections[sectionIdx];
+	resident.lastUse = ++residentUses;
+	if (!resident.Get()) {
+		const auto key = CacheKey(sectionIdx, GrannyRelocationMode::None);
+		if (!lazyCache || !lazyCache->Find(key, secHdr.memSize, std::max<size_t>(secHdr.alignment, 1u), resident.cached)) {
+			const auto slack = Oodle::Oodle1Decompressor::RepeatSlack;
+			resident.data.reset(new uint8_t[secHdr.memSize + slack]);
+			if (!LoadSection(lazyDecomps, sectionIdx, resident.data.get(), slack, GrannyLoadOptions())) {
+				resident.data.reset();
+				return nullptr;
+			} else if (lazyCache && CrcMatches()) {
+				lazyCache->Store(key, resident.data.get(), secHdr.memSize);
+			}
 		}
-		memOffset += secHdr.memSize;
+		residentBytes += secHdr.memSize;
+		Evict(sectionIdx);
 	}
+	return resident.Get();
+}
+
+void GrannyFile::ClearPadding(uint32_t sectionIdx) {
+	// Only the padding which follows the section; it's written after the section, in case the section's
+	// decode used it as slack
+	const auto paddingStart = sectionMemOffsets[sectionIdx] + sectionHeaders[sectionIdx].memSize;
+	const auto paddingEnd = ((sectionIdx + 1) < sectionMemOffsets.size()) ? sectionMemOffsets[sectionIdx + 1] : dataSize;
+	std::memset(&data[paddingStart], 0, paddingEnd - paddingStart);
+}
+
+void GrannyFile::Evict(uint32_t keepSectionIdx) {
+	// Files hold few enough sections that a scan for the oldest is cheaper than maintaining a list
+	while ((residentLimit > 0u) && (residentBytes > residentLimit)) {
+		auto oldestIdx = UINT32_MAX;
+		for (auto sectionIdx = 0u; sectionIdx < residentSections.size(); sectionIdx++) {
+			const auto& resident = residentSections[sectionIdx];
+			if (resident.Get() && (sectionIdx != keepSectionIdx) && ((oldestIdx == UINT32_MAX) || (resident.lastUse < residentSections[oldestIdx].lastUse))) {
+				oldestIdx = sectionIdx;
+			}
+		}
+		if (oldestIdx == UINT32_MAX) {
+			break;
+		}
+		residentSections[oldestIdx].data.reset();
+		residentSections[oldestIdx].cached.Reset();
+		residentBytes -= sectionHeaders[oldestIdx].memSize;
+	}
+}
+
+// Starts come from the caller, and a section the serial path never decoded (raw, empty or lazily loaded) has only
+// default ones, which would have the bitstream divide by a zero modulus
+static bool StreamStartsUsable(const GrannySectionHeader& header, const GrannyStreamStarts& starts) {
+	if (header.fileSize < GrannyFile::Oodle1HeadersSize) {
+		return false;
+	}
+	for (const auto& start : starts) {
+		if ((start.inputOffset > (header.fileSize - GrannyFile::Oodle1HeadersSize)) || !start.srModulus || (start.sr >= start.srModulus) ||
+				(start.lsb > 1)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool GrannyFile::LoadSection(Decompressors& decomps, uint32_t sectionIdx, uint8_t *output, size_t outputSlack, const GrannyLoadOptions& options) {
+	const auto& secHdr = sectionHeaders[sectionIdx];
+	if (secHdr.memSize <= 0u) {
+		return true;
+	}
+	const auto input = fileData + secHdr.fileOffset;
+	auto loaded = false;
+	switch (secHdr.encoding) {
+		case GrannySectionHeader::Encoding::Raw:
+			std::memcpy(output, input, secHdr.fileSize);
+			// The output isn't cleared beforehand, and the previous section may have used this one's bytes as slack
+			std::memset(&output[secHdr.fileSize], 0, secHdr.memSize - secHdr.fileSize);
+			loaded = true;
+			break;
+		case GrannySectionHeader::Encoding::Oodle1: {
+			// Each section's stats are only ever touched by the one thread decoding it
+			const auto stats = options.collectStats ? &sectionStats[sectionIdx] : nullptr;
+			if (stats) {
+				*stats = Oodle::Oodle1Stats();
+			}
+			// Starts which couldn't have come from a decode of this section are ignored, as though none were given
+			if (options.parallelStreams && (sectionIdx < options.streamStarts.size()) && StreamStartsUsable(secHdr, options.streamStarts[sectionIdx])) {
+				streamStarts[sectionIdx] = options.streamStarts[sectionIdx];
+				loaded = DecompressOodle1Parallel(decomps, secHdr, input, output, outputSlack, streamStarts[sectionIdx], stats, options.interleaveStreams);
+			} else {
+				loaded = DecompressOodle1(decomps, secHdr, input, output, outputSlack, streamStarts[sectionIdx], stats);
+			}
+			break;
+		}
+		case GrannySectionHeader::Encoding::Oodle0:
+		default:
+			std::cerr << Formatted("Granny section uses unsupported encoding %d", secHdr.encoding) << std::endl;
+			return false;
+	}
+	if (!loaded) {
+		return false;
+	}
+	// Marshalling comes first, so that relocated pointers are left in the host's order
+	Marshal(sectionIdx, output);
+	return Relocate(sectionIdx, output, options.relocation);
+}
+
+void GrannyFile::Marshal(uint32_t sectionIdx, uint8_t *output) const {
+	if (!NeedsMarshalling(sectionIdx)) {
+		return;
+	}
+	// Entries were validated as they were loaded, so every run lies within the section, and has a size the
+	// swap supports
+	for (auto marshalIdx = marshallingStarts[sectionIdx]; marshalIdx < marshallingStarts[sectionIdx + 1]; marshalIdx++) {
+		const auto& marshal = marshalling[marshalIdx];
+		ByteSwap::Swap(&output[marshal.offset], marshal.count, marshal.elementSize);
+	}
+}
+
+bool GrannyFile::Relocate(uint32_t sectionIdx, uint8_t *output, GrannyRelocationMode mode) {
+	if (mode == GrannyRelocationMode::None) {
+		return true;
+	} else if ((mode == GrannyRelocationMode::Pointers) && (sizeof(uintptr_t) != PointerSize)) {
+		std::cerr << Formatted("Granny file pointers are %d bytes, so can't hold this platform's pointers", PointerSize) << std::endl;
+		return false;
+	} else if ((mode == GrannyRelocationMode::Offsets) && (dataSize > UINT32_MAX)) {
+		std::cerr << Formatted("Granny file data is too large (%zx) to relocate to offsets", dataSize) << std::endl;
+		return false;
+	}
+	// Relocations are validated as they're loaded, and every target's offset is known up front, so this only
+	// ever touches the section that's just been decompressed
+	const auto base = (mode == GrannyRelocationMode::Pointers) ? reinterpret_cast<uintptr_t>(data) : 0u;
+	for (auto relocIdx = relocationStarts[sectionIdx]; relocIdx < relocationStarts[sectionIdx + 1]; relocIdx++) {
+		const auto& reloc = relocations[relocIdx];
+		const auto target = static_cast<uint32_t>(base + sectionMemOffsets[reloc.targetSection] + reloc.targetOffset);
+		std::memcpy(&output[reloc.offset], &target, sizeof(target));
+	}
+	return true;
+}
+
+void GrannyFile::LoadOodle1Headers(const uint8_t *input, std::array<uint32_t,Oodle1HeadersSize / 4>& headers) const {
+	// Copied out, since the section's data needn't be word-aligned in memory, and may need swapping
+	std::memcpy(headers.data(), input, Oodle1HeadersSize);
+	if (bigEndian != HostBigEndian) {
+		for (auto& word : headers) {
+			word = __builtin_bswap32(word);
+		}
+	}
+}
 
+static bool ValidateOodle1Section(const GrannySectionHeader& header) {
+	if (header.fileSize < GrannyFile::Oodle1HeadersSize) {
+		std::cerr << Formatted("Granny section is too small (%x) to hold its Oodle1 headers", header.fileSize) << std::endl;
+		return false;
+	} else if ((header.stream0Stop > header.memSize) || (header.stream1Stop > header.memSize)) {
+		std::cerr << Formatted("Granny section stream boundaries (%x, %x) lie beyond its memory size (%x)", header.stream0Stop, header.stream1Stop, header.memSize) << std::endl;
+		return false;
+	}
 	return true;
 }
 
-void GrannyFile::DecompressOodle1(const GrannySectionHeader& header, const uint8_t *input, uint8_t *output) {
-	const uint32_t *headerPtr = reinterpret_cast<const uint32_t*>(input);
-	Oodle::Oodle1Bitstream bs(input + 36);
-	const std::array<size_t,3> streamEndOffsets = { header.stream0Stop, header.stream1Stop, header.memSize };
+bool GrannyFile::DecompressOodle1(Decompressors& decomps, const GrannySectionHeader& header, const uint8_t *input, uint8_t *output, size_t outputSlack, GrannyStreamStarts& starts, Oodle::Oodle1Stats *stats) {
+	if (!ValidateOodle1Section(header)) {
+		return false;
+	}
+	if (!decomps[0]) {
+		decomps[0] = std::make_unique<Oodle::Oodle1Decompressor>();
+	}
+	auto& decomp = *decomps[0];
+	std::array<uint32_t,Oodle1HeadersSize / 4> headers;
+	LoadOodle1Headers(input, headers);
+	const uint32_t *headerPtr = headers.data();
+	const auto streamsInput = input + Oodle1HeadersSize;
+	const auto streamsInputSize = header.fileSize - Oodle1HeadersSize;
+	Oodle::Oodle1Bitstream bs(streamsInput, streamsInputSize);
+	const std::array<size_t,Oodle1StreamCount> streamEndOffsets = { header.stream0Stop, header.stream1Stop, header.memSize };
 	size_t outputOffset = 0u;
-	for (auto streamIdx = 0u; streamIdx < 3u; streamIdx++) {
+	for (auto streamIdx = 0u; streamIdx < Oodle1StreamCount; streamIdx++) {
+		starts[streamIdx] = bs.Save(streamsInput);
 		if (outputOffset >= header.memSize) {
-			break;
+			continue;
 		}
-		Oodle::Oodle1Decompressor decomp(bs);
-		decomp.Initialize(headerPtr);
+		decomp.Reset(bs, headerPtr);
 		headerPtr += 3;
-		while (outputOffset < streamEndOffsets[streamIdx]) {
-			outputOffset += decomp.Decompress(&output[outputOffset]);
+		if (outputOffset < streamEndOffsets[streamIdx]) {
+			// Granny files come from anywhere, so the stream is never trusted to stay within its bounds
+			const auto slack = (streamEndOffsets[streamIdx] + Oodle::Oodle1Decompressor::RepeatSlack) <= (header.memSize + outputSlack);
+			const auto length = streamEndOffsets[streamIdx] - outputOffset;
+			const auto decompressed = stats ? decomp.Decompress<Oodle::Oodle1WithStats<Oodle::Oodle1Checked>>(&output[outputOffset], length, slack) :
+					decomp.Decompress<Oodle::Oodle1Checked>(&output[outputOffset], length, slack);
+			if (decompressed != length) {
+				std::cerr << Formatted("Granny section Oodle1 stream %d is ill-formed (error %d)", streamIdx, decomp.GetError()) << std::endl;
+				return false;
+			}
+			if (stats) {
+				*stats += decomp.GetStats();
+			}
+			outputOffset += length;
 		}
 	}
+	return true;
+}
+
+bool GrannyFile::DecompressOodle1Parallel(Decompressors& decomps, const GrannySectionHeader& header, const uint8_t *input, uint8_t *output, size_t outputSlack, const GrannyStreamStarts& starts, Oodle::Oodle1Stats *stats, bool interleave) {
+	if (!ValidateOodle1Section(header)) {
+		return false;
+	}
+	std::array<uint32_t,Oodle1HeadersSize / 4> headers;
+	LoadOodle1Headers(input, headers);
+	const auto streamsInput = input + Oodle1HeadersSize;
+	const auto streamsInputSize = header.fileSize - Oodle1HeadersSize;
+
+	// Each stream's output range is [stream start, stream end), clipped in the same way as the serial decode
+	std::array<size_t,Oodle1StreamCount + 1> streamOffsets = { 0u, header.stream0Stop, header.stream1Stop, header.memSize };
+	for (auto streamIdx = 1u; streamIdx <= Oodle1StreamCount; streamIdx++) {
+		streamOffsets[streamIdx] = std::max(streamOffsets[streamIdx], streamOffsets[streamIdx - 1]);
+	}
+	std::array<bool,Oodle1StreamCount> succeeded = { true, true, true };
+	const auto decodeStream = [&](uint32_t streamIdx) {
+		const auto length = streamOffsets[streamIdx + 1] - streamOffsets[streamIdx];
+		if (length == 0u) {
+			return;
+		}
+		auto& decomp = *decomps[streamIdx];
+		Oodle::Oodle1Bitstream bs(streamsInput, streamsInputSize, starts[streamIdx]);
+		decomp.Reset(bs, &headers[streamIdx * 3]);
+		// Only the last stream may overrun its end; the others would race with the stream that follows
+		const auto slack = (streamIdx == (Oodle1StreamCount - 1)) && (Oodle::Oodle1Decompressor::RepeatSlack <= outputSlack);
+		const auto decompressed = stats ? decomp.Decompress<Oodle::Oodle1WithStats<Oodle::Oodle1Checked>>(&output[streamOffsets[streamIdx]], length, slack) :
+				decomp.Decompress<Oodle::Oodle1Checked>(&output[streamOffsets[streamIdx]], length, slack);
+		succeeded[streamIdx] = (decompressed == length);
+	};
+
+	for (auto& decomp : decomps) {
+		if (!decomp) {
+			decomp = std::make_unique<Oodle::Oodle1Decompressor>();
+		}
+	}
+	if (interleave && !stats) {
+		std::array<Oodle::Oodle1Bitstream,Oodle1StreamCount> streams = {
+			Oodle::Oodle1Bitstream(streamsInput, streamsInputSize, starts[0]),
+			Oodle::Oodle1Bitstream(streamsInput, streamsInputSize, starts[1]),
+			Oodle::Oodle1Bitstream(streamsInput, streamsInputSize, starts[2]),
+		};
+		std::array<Oodle::Oodle1Lane,Oodle1StreamCount> lanes;
+		for (auto streamIdx = 0u; streamIdx < Oodle1StreamCount; streamIdx++) {
+			auto& lane = lanes[streamIdx];
+			lane.decomp = decomps[streamIdx].get();
+			lane.decomp->Reset(streams[streamIdx], &headers[streamIdx * 3]);
+			lane.output = &output[streamOffsets[streamIdx]];
+			lane.length = streamOffsets[streamIdx + 1] - streamOffsets[streamIdx];
+			// The lanes are decoded together, so as with threads, only the last may overrun its end. It still
+			// advances with the others, since DecompressInterleaved keeps a group's lanes together whatever their slack
+			lane.outputSlack = (streamIdx == (Oodle1StreamCount - 1)) && (Oodle::Oodle1Decompressor::RepeatSlack <= outputSlack);
+		}
+		Oodle::Oodle1Decompressor::DecompressInterleaved<Oodle::Oodle1Checked>(lanes.data(), lanes.size());
+		for (auto streamIdx = 0u; streamIdx < Oodle1StreamCount; streamIdx++) {
+			if (lanes[streamIdx].decompressed != lanes[streamIdx].length) {
+				std::cerr << Formatted("Granny section Oodle1 stream %d is ill-formed (error %d)", streamIdx, decomps[streamIdx]->GetError()) << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+	std::array<std::thread,Oodle1StreamCount - 1> workers;
+	for (auto streamIdx = 1u; streamIdx < Oodle1StreamCount; streamIdx++) {
+		workers[streamIdx - 1] = std::thread(decodeStream, streamIdx);
+	}
+	decodeStream(0u);
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	for (auto streamIdx = 0u; streamIdx < Oodle1StreamCount; streamIdx++) {
+		if (!succeeded[streamIdx]) {
+			std::cerr << Formatted("Granny section Oodle1 stream %d is ill-formed (error %d)", streamIdx, decomps[streamIdx]->GetError()) << std::endl;
+			return false;
+		} else if (stats && (streamOffsets[streamIdx + 1] > streamOffsets[streamIdx])) {
+			// The streams' stats are only gathered up once every thread is done with its own
+			*stats += decomps[streamIdx]->GetStats();
+		}
+	}
+	return true;
 }
@@ -27,8 +27,11 @@
 
 #include <array>
 #include <cstdint>
+#include <memory>
+#include <oodle/Oodle1.h>
 #include <stdexcept>
 #include <vector>
+#include "GrannyCache.h"
 
 struct Buffer;
 
@@ -52,44 +55,225 @@ struct GrannySectionHeader {
 
 	GrannySectionHeader() = default;
 
-	bool Load(Buffer& buffer, uint32_t totalFileSize);
+	bool Load(Buffer& buffer, uint32_t totalFileSize, bool bigEndian);
+};
+
+// A pointer within one section to a point in another (or the same) section
+struct GrannyRelocation {
+	uint32_t offset = 0u;			// Of the pointer, within the section holding it
+	uint32_t targetSection = 0u;
+	uint32_t targetOffset = 0u;		// Within the target section
+};
+
+// A run of elements within a section which are stored in the file's byte order, rather than as bytes
+struct GrannyMarshalling {
+	uint32_t offset = 0u;			// Of the first element, within the section
+	uint32_t count = 0u;
+	uint32_t elementSize = 1u;		// 1, 2, 4 or 8
+};
+
+enum class GrannyRelocationMode {
+	None = 0,		// Pointers are left as the file has them
+	Offsets,		// Each pointer is set to its target's offset within GetData()
+	Pointers,		// Each pointer is set to its target's address; only possible where pointers are 32 bits, as the file's are
+};
+
+// Where each of a section's three Oodle1 streams begins in its compressed input
+using GrannyStreamStarts = std::array<Oodle::Oodle1Bitstream::State,3>;
+
+struct GrannyLoadOptions {
+	// Decode the three Oodle1 streams of a section concurrently. This requires knowing where each one
+	// begins, so it only applies to sections whose starts are given below; the rest, and any whose starts
+	// aren't valid for them, are decoded serially.
+	bool parallelStreams = false;
+	// With parallelStreams, decode the three streams interleaved on the section's own thread, rather than on
+	// threads of their own; better when every core is already busy with a section. Three decompressors' state
+	// needs most of a 2MiB L2, so on cores with no more than that, it's no faster than serial decoding (see
+	// oodle_bench's section and lanes groups). Not while collecting stats.
+	bool interleaveStreams = false;
+	std::vector<GrannyStreamStarts> streamStarts;	// Per section, as returned from GetStreamStarts
+	// Decode up to this many sections at once. Sections decoded in parallel can't borrow the bytes
+	// that follow them as repeat slack.
+	unsigned sectionThreads = 1u;
+	// Count what the decompressor does for each Oodle1 section, at some cost in speed (see GetSectionStats)
+	bool collectStats = false;
+	// Relocate each section straight after decompressing (and marshalling) it, while it's still in cache.
+	// Sections which are decompressed lazily, by GetSection, are marshalled but never relocated.
+	GrannyRelocationMode relocation = GrannyRelocationMode::None;
+	// Check the file's CRC while it's decompressed, and fail the load if it doesn't match. The CRC is taken
+	// on a thread of its own, or in chunks by the section threads once they've run out of sections.
+	bool verifyCrc = false;
+	// Map the data in from this cache, if it holds the file, rather than decoding it; otherwise add the file once it
+	// has been decoded, and its CRC found to match. Not while collecting stats, nor with relocation to pointers,
+	// which differ from one load to the next. Sections loaded from the cache have no stream starts recorded.
+	GrannyCache *cache = nullptr;
 };
 
 struct GrannyFile {
 public:
+	static constexpr auto CrcChunkSize = 0x100000u;
+	static constexpr auto Oodle1HeadersSize = 36u;
+	static constexpr auto MarshallingSize = 12u;
+	static constexpr auto MaxSectionAlignment = 0x10000u;
+	static constexpr auto Oodle1StreamCount = 3u;
+	static constexpr auto PointerSize = 4u;
+	static constexpr auto PrimaryHeaderSize = 88u;
+	static constexpr auto RelocationSize = 12u;
 	static constexpr auto SectionHeaderSize = 44u;
 	static constexpr auto SignatureLength = 16u;
 	static constexpr std::array<uint8_t,SignatureLength> SignatureLE = {
 		0xb8, 0x67, 0xb0, 0xca, 0xf8, 0x6d, 0xb1, 0x0f,
 		0x84, 0x72, 0x8c, 0x7e, 0x5e, 0x19, 0x00, 0x1e,
 	};
+	// The same words, byte-swapped; everything after the signature is then big-endian too
+	static constexpr std::array<uint8_t,SignatureLength> SignatureBE = {
+		0xca, 0xb0, 0x67, 0xb8, 0x0f, 0xb1, 0x6d, 0xf8,
+		0x7e, 0x8c, 0x72, 0x84, 0x1e, 0x00, 0x19, 0x5e,
+	};
+	static constexpr bool HostBigEndian = (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
 	static constexpr auto UserDataSize = 16u;
 
 	GrannyFile() = default;
 
-	GrannyFile(const std::vector<uint8_t>& raw) {
-		if (!LoadFromBytes(raw)) {
+	GrannyFile(const std::vector<uint8_t>& raw, const GrannyLoadOptions& options = GrannyLoadOptions()) :
+			GrannyFile(raw.data(), raw.size(), options) { }
+
+	GrannyFile(const uint8_t *raw, size_t size, const GrannyLoadOptions& options = GrannyLoadOptions()) {
+		if (!LoadFromBytes(raw, size, options)) {
 			throw std::runtime_error("Failed to parse Granny data");
 		}
 	}
 
-	const std::vector<uint8_t>& GetData() const { return data; }
-	bool LoadFromBytes(const std::vector<uint8_t>& raw);
+	// A view of the decompressed sections, in order, each aligned as its header asks (any padding is zeroed),
+	// and with every marshalled element in the host's byte order; valid until the next load
+	const uint8_t *GetData() const { return data; }
+	size_t GetDataSize() const { return dataSize; }
+	// The largest alignment any section asks for; the data is aligned to this within its allocation
+	size_t GetDataAlignment() const { return dataAlignment; }
+	// Recorded while loading; may be cached and passed back in to later loads of the same file
+	const std::vector<GrannyStreamStarts>& GetStreamStarts() const { return streamStarts; }
+
+	bool LoadFromBytes(const std::vector<uint8_t>& raw, const GrannyLoadOptions& options = GrannyLoadOptions()) {
+		return LoadFromBytes(raw.data(), raw.size(), options);
+	}
+	// The compressed bytes are read in place (e.g. from a mapped file), and never copied
+	bool LoadFromBytes(const uint8_t *raw, size_t size, const GrannyLoadOptions& options = GrannyLoadOptions()) {
+		return LoadHeaders(raw, size) && Decompress(options);
+	}
+
+	// Loading may instead be split into its two halves, so that the caller can provide the output memory.
+	// The raw bytes must remain valid until Decompress has returned.
+	bool LoadHeaders(const uint8_t *raw, size_t size);
+	// Decompresses into a single allocation owned by the file
+	bool Decompress(const GrannyLoadOptions& options = GrannyLoadOptions());
+	// Decompresses into at least GetDataSize() bytes of caller memory, which should be aligned to
+	// GetDataAlignment(). Anything beyond that may be used as scratch space, which speeds up the decode of the
+	// final section.
+	bool Decompress(uint8_t *output, size_t outputSize, const GrannyLoadOptions& options = GrannyLoadOptions());
+
+	// Checks the CRC on its own, e.g. for files which are only ever decompressed lazily
+	bool VerifyCrc() const;
+
+	// Alternatively, after LoadHeaders alone, each section is decompressed the first time it's requested; the
+	// raw bytes must then remain valid for as long as sections are. Returns nullptr if the section can't be
+	// decompressed. The view is valid until the section is evicted, or the file is reloaded.
+	const uint8_t *GetSection(uint32_t sectionIdx);
+	size_t GetSectionCount() const { return sectionHeaders.size(); }
+	size_t GetSectionSize(uint32_t sectionIdx) const { return sectionHeaders[sectionIdx].memSize; }
+	const GrannySectionHeader& GetSectionHeader(uint32_t sectionIdx) const { return sectionHeaders[sectionIdx]; }
+	size_t GetSectionOffset(uint32_t sectionIdx) const { return sectionMemOffsets[sectionIdx]; }
+	// The section's relocation and marshalling tables, as read (and validated) with the headers
+	std::vector<GrannyRelocation> GetSectionRelocations(uint32_t sectionIdx) const {
+		return std::vector<GrannyRelocation>(relocations.begin() + relocationStarts[sectionIdx], relocations.begin() + relocationStarts[sectionIdx + 1]);
+	}
+	std::vector<GrannyMarshalling> GetSectionMarshalling(uint32_t sectionIdx) const {
+		return std::vector<GrannyMarshalling>(marshalling.begin() + marshallingStarts[sectionIdx], marshalling.begin() + marshallingStarts[sectionIdx + 1]);
+	}
+	// All three streams' counts together, from the last load which collected stats
+	const Oodle::Oodle1Stats& GetSectionStats(uint32_t sectionIdx) const { return sectionStats[sectionIdx]; }
+	bool IsBigEndian() const { return bigEndian; }
+	uint64_t GetRootNodeType() const { return rootNodeType; }
+	uint64_t GetRootNodeObject() const { return rootNodeObject; }
+	uint32_t GetUserTag() const { return userTag; }
+	const std::array<uint8_t,UserDataSize>& GetUserData() const { return userData; }
+	// Caps the bytes of lazily decompressed sections held at once (0 for no cap), evicting the least recently
+	// requested first. The most recently requested section is always kept, however large it is.
+	void SetResidentLimit(size_t bytes) { residentLimit = bytes; Evict(UINT32_MAX); }
+	// Looks lazily decompressed sections up in this cache, and adds them to it, as GrannyLoadOptions::cache does
+	void SetCache(GrannyCache *cache) { lazyCache = cache; }
 
 private:
+	using Decompressors = std::array<std::unique_ptr<Oodle::Oodle1Decompressor>,Oodle1StreamCount>;
+
+	struct ResidentSection {
+		std::unique_ptr<uint8_t[]> data;
+		GrannyCache::Entry cached;		// Instead of data, when the section was found in the cache
+		uint64_t lastUse = 0u;
+
+		const uint8_t *Get() const { return data ? data.get() : cached.GetData(); }
+	};
+
+	bool bigEndian = false;
+	GrannyCache::Entry cachedData;	// Mapped in as the data, when the whole file was found in the cache
 	uint32_t crc = 0u;
-	std::vector<uint8_t> data;
+	bool crcChecked = false;	// Whether the CRC has been checked since the headers were loaded, and if so, whether it matched
+	bool crcMatched = false;
+	size_t crcStart = 0u;		// The CRC covers everything from the section headers to the end of the file
+	uint8_t *data = nullptr;
 	uint32_t dataBase = 0u;
+	size_t dataAlignment = 1u;
+	size_t dataCapacity = 0u;
+	size_t dataSize = 0u;
+	const uint8_t *fileData = nullptr;
+	std::vector<GrannyMarshalling> marshalling;
+	std::vector<size_t> marshallingStarts;	// As relocationStarts
+	std::unique_ptr<uint8_t[]> ownedData;
+	GrannyCache *lazyCache = nullptr;
+	Decompressors lazyDecomps;
+	size_t residentBytes = 0u;
+	size_t residentLimit = 0u;
+	std::vector<ResidentSection> residentSections;
+	uint64_t residentUses = 0u;
 	uint64_t rootNodeType = 0u;
 	uint64_t rootNodeObject = 0u;
+	std::vector<GrannyRelocation> relocations;
+	std::vector<size_t> relocationStarts;	// Index of each section's first relocation, and then the total
 	std::vector<GrannySectionHeader> sectionHeaders;
+	std::vector<size_t> sectionMemOffsets;
+	std::vector<Oodle::Oodle1Stats> sectionStats;
+	std::vector<GrannyStreamStarts> streamStarts;
 	uint32_t totalFileSize = 0u;
 	uint32_t totalHeaderSize = 0u;
 	std::array<uint8_t,UserDataSize> userData = { 0 };
 	uint32_t userTag = 0u;
 	uint32_t version = 0u;
 
-	void DecompressOodle1(const GrannySectionHeader& header, const uint8_t *input, uint8_t *output);
+	GrannyCache::Key CacheKey(uint32_t sectionIdx, GrannyRelocationMode mode) const;
+	bool CanCache(const GrannyLoadOptions& options) const {
+		return options.cache && !options.collectStats && (options.relocation != GrannyRelocationMode::Pointers);
+	}
+	bool CheckCrc(const std::vector<uint32_t>& chunkCrcs) const;
+	bool CheckDecodedCrc(const std::vector<uint32_t>& chunkCrcs);
+	// Verifies the CRC the first time it's asked for, and remembers the answer
+	bool CrcMatches();
+	// Decompress(output, outputSize, options), but probing the cache only if probeCache is set; a caller which
+	// has already missed in it stores into it all the same
+	bool DecompressInto(uint8_t *output, size_t outputSize, const GrannyLoadOptions& options, bool probeCache);
+	bool DecodeSections(const GrannyLoadOptions& options);
+	void ClearPadding(uint32_t sectionIdx);
+	size_t GetCrcChunkCount() const { return ((totalFileSize - crcStart) + CrcChunkSize - 1) / CrcChunkSize; }
+	uint32_t GetCrcChunk(size_t chunkIdx) const;
+	void Evict(uint32_t keepSectionIdx);
+	bool LoadFixups(const uint8_t *raw);
+	void LoadOodle1Headers(const uint8_t *input, std::array<uint32_t,Oodle1HeadersSize / 4>& headers) const;
+	void Marshal(uint32_t sectionIdx, uint8_t *output) const;
+	bool NeedsMarshalling(uint32_t sectionIdx) const {
+		return (bigEndian != HostBigEndian) && (marshallingStarts[sectionIdx + 1] > marshallingStarts[sectionIdx]);
+	}
+	bool Relocate(uint32_t sectionIdx, uint8_t *output, GrannyRelocationMode mode);
+	bool LoadSection(Decompressors& decomps, uint32_t sectionIdx, uint8_t *output, size_t outputSlack, const GrannyLoadOptions& options);
+	bool DecompressOodle1(Decompressors& decomps, const GrannySectionHeader& header, const uint8_t *input, uint8_t *output, size_t outputSlack, GrannyStreamStarts& starts, Oodle::Oodle1Stats *stats);
+	bool DecompressOodle1Parallel(Decompressors& decomps, const GrannySectionHeader& header, const uint8_t *input, uint8_t *output, size_t outputSlack, const GrannyStreamStarts& starts, Oodle::Oodle1Stats *stats, bool interleave);
 };
 
 #endif
@@ -0,0 +1,132 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#include <atomic>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "GrannyCache.h"
+#include "Format.h"
+
+GrannyCache::Entry& GrannyCache::Entry::operator=(Entry&& rhs) {
+	if (this != &rhs) {
+		Reset();
+		std::swap(mapping, rhs.mapping);
+		std::swap(mappingSize, rhs.mappingSize);
+		std::swap(data, rhs.data);
+	}
+	return *this;
+}
+
+void GrannyCache::Entry::Reset() {
+	if (mapping) {
+		munmap(mapping, mappingSize);
+	}
+	mapping = nullptr;
+	mappingSize = 0u;
+	data = nullptr;
+}
+
+std::string GrannyCache::Path(const Key& key) const {
+	const auto section = (key.section == WholeFile) ? std::string("all") : Formatted("%u", key.section);
+	return Formatted("%s/%08x-%08x-%s-%u.granny-cache", directory.c_str(), key.crc, key.fileSize, section.c_str(),
+			static_cast<unsigned>(key.relocation));
+}
+
+bool GrannyCache::Find(const Key& key, size_t size, size_t alignment, Entry& entry) const {
+	entry.Reset();
+	const auto fd = open(Path(key).c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	// Anything that doesn't match exactly is just a miss; it's replaced once the data has been decoded
+	Header header;
+	struct stat st;
+	const auto valid = (pread(fd, &header, sizeof(header), 0) == sizeof(header)) && (header.signature == Signature) &&
+			(header.crc == key.crc) && (header.fileSize == key.fileSize) && (header.section == key.section) &&
+			(header.relocation == static_cast<uint32_t>(key.relocation)) && (header.size == size) && (fstat(fd, &st) == 0) &&
+			(static_cast<uint64_t>(st.st_size) == (DataOffset + size));
+	if (!valid || !size) {
+		close(fd);
+		return false;
+	}
+	// mmap only promises page alignment, so a section asking for more is mapped into a reservation large enough to
+	// hold it at any alignment, which is released along with it
+	const auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const auto reservationSize = (alignment > pageSize) ? (size + alignment) : size;
+	auto mapping = MAP_FAILED;
+	auto data = MAP_FAILED;
+	if (reservationSize == size) {
+		mapping = data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, DataOffset);
+	} else {
+		mapping = mmap(nullptr, reservationSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapping != MAP_FAILED) {
+			const auto aligned = (reinterpret_cast<uintptr_t>(mapping) + alignment - 1u) & ~static_cast<uintptr_t>(alignment - 1u);
+			data = mmap(reinterpret_cast<void*>(aligned), size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, DataOffset);
+			if (data == MAP_FAILED) {
+				munmap(mapping, reservationSize);
+				mapping = MAP_FAILED;
+			}
+		}
+	}
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+	entry.mapping = mapping;
+	entry.mappingSize = reservationSize;
+	entry.data = static_cast<const uint8_t*>(data);
+	return true;
+}
+
+bool GrannyCache::Store(const Key& key, const uint8_t *data, size_t size) const {
+	// Concurrent stores of the same entry, from this process or another, each write a file of their own
+	static std::atomic<unsigned> storeCount(0u);
+	const auto path = Path(key);
+	const auto tempPath = Formatted("%s.%d-%u.tmp", path.c_str(), static_cast<int>(getpid()), storeCount++);
+	const auto fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	Header header;
+	header.crc = key.crc;
+	header.fileSize = key.fileSize;
+	header.section = key.section;
+	header.relocation = static_cast<uint32_t>(key.relocation);
+	header.size = size;
+	auto written = (pwrite(fd, &header, sizeof(header), 0) == sizeof(header)) && (ftruncate(fd, DataOffset) == 0);
+	for (size_t offset = 0u; written && (offset < size); ) {
+		const auto count = pwrite(fd, data + offset, size - offset, DataOffset + offset);
+		written = (count > 0);
+		offset += written ? static_cast<size_t>(count) : 0u;
+	}
+	written = (close(fd) == 0) && written;
+	if (!written || (rename(tempPath.c_str(), path.c_str()) != 0)) {
+		unlink(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,102 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#ifndef GRANNYCACHE_H
+#define GRANNYCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+enum class GrannyRelocationMode;
+
+// Decoded Granny data kept on disk between loads, so that a file which has been loaded before needn't be decoded
+// again. Each entry holds one section (or all of a file's data, laid out as GetData presents it), marshalled and
+// relocated, and is keyed by the file's CRC and size, the section and the relocation mode. Entries are mapped
+// straight back in, so a hit costs page faults rather than a decode. Entries are in the host's byte order, and are
+// trusted as they are, so the directory should be private to the user.
+class GrannyCache {
+public:
+	static constexpr auto WholeFile = UINT32_MAX;	// The section of an entry holding all of a file's data
+
+	struct Key {
+		uint32_t crc = 0u;
+		uint32_t fileSize = 0u;
+		uint32_t section = WholeFile;
+		GrannyRelocationMode relocation{};
+	};
+
+	// A read-only, private mapping of an entry's data, which is unmapped once the entry is destroyed
+	class Entry {
+	public:
+		Entry() = default;
+		Entry(const Entry&) = delete;
+		Entry& operator=(const Entry&) = delete;
+		Entry(Entry&& rhs) { *this = std::move(rhs); }
+		Entry& operator=(Entry&& rhs);
+		~Entry() { Reset(); }
+
+		const uint8_t *GetData() const { return data; }
+		explicit operator bool() const { return data != nullptr; }
+		void Reset();
+
+	private:
+		void *mapping = nullptr;
+		size_t mappingSize = 0u;
+		const uint8_t *data = nullptr;
+
+		friend class GrannyCache;
+	};
+
+	// The directory must already exist
+	explicit GrannyCache(std::string directory_) : directory(std::move(directory_)) { }
+
+	// Maps in the key's entry, if there is one of exactly size bytes, at an address aligned to alignment (a power of two)
+	bool Find(const Key& key, size_t size, size_t alignment, Entry& entry) const;
+	// Adds an entry, replacing any there was. Entries are written aside and renamed into place, so a concurrent
+	// Find never sees one half-written. Failing only means that the next load decodes again
+	bool Store(const Key& key, const uint8_t *data, size_t size) const;
+
+private:
+	// Entry data starts this far into its file, a multiple of any page size, so that it can be mapped in place.
+	// The gap before it is left as a hole in the file, wherever the file system allows
+	static constexpr auto DataOffset = 0x10000u;
+	static constexpr uint64_t Signature = 0x31454843594e5247u;	// "GRNYCHE1"
+
+	struct Header {
+		uint64_t signature = Signature;
+		uint32_t crc = 0u;
+		uint32_t fileSize = 0u;
+		uint32_t section = 0u;
+		uint32_t relocation = 0u;
+		uint64_t size = 0u;
+	};
+
+	std::string Path(const Key& key) const;
+
+	std::string directory;
+};
+
+#endif
@@ -0,0 +1,276 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include "GrannyWriter.h"
+#include "Buffer.h"
+#include "ByteSwap.h"
+#include "Crc32.h"
+#include "Format.h"
+
+// The file info that follows the signature, and which section-header offsets are relative to
+static constexpr auto FileInfoOffset = 32u;
+static constexpr auto FileVersion = 6u;
+// Section data is at least word-aligned within the file, since the Oodle1 headers are read as words
+static constexpr auto SectionFileAlignment = 4u;
+
+std::array<uint32_t,2> GrannyWriter::PlanStreamStops(uint32_t size, uint32_t minStreamSize) {
+	const auto streamCount = std::clamp<uint32_t>(size / std::max(minStreamSize, 1u), 1u, GrannyFile::Oodle1StreamCount);
+	// Each stream restarts its literal contexts (which are chosen by position & 3), so the stops are kept
+	// word-aligned, to leave the contexts in phase with the section's data
+	std::array<uint32_t,GrannyFile::Oodle1StreamCount> stops = { size, size, size };
+	for (auto streamIdx = 1u; streamIdx < streamCount; streamIdx++) {
+		stops[streamIdx - 1] = ((size / streamCount) * streamIdx) & ~3u;
+	}
+	return { stops[0], stops[1] };
+}
+
+bool GrannyWriter::Write(std::vector<uint8_t>& output, const GrannyWriteOptions& options) const {
+	struct StreamJob {
+		uint32_t sectionIdx;
+		uint32_t streamIdx;
+	};
+	struct SectionWork {
+		GrannySectionHeader header;
+		std::array<uint32_t,GrannyFile::Oodle1StreamCount + 1> streamOffsets = { 0u };
+		std::array<std::vector<Oodle::Oodle1Compressor::Token>,GrannyFile::Oodle1StreamCount> tokens;
+		std::atomic<uint32_t> pendingStreams;
+		std::vector<uint8_t> payload;	// Empty for sections stored raw
+		const uint8_t *data = nullptr;	// The section's data in the file's byte order
+		std::vector<uint8_t> swapped;	// Backs data, for sections which needed marshalling
+	};
+	const auto appendU32 = [this](Buffer& buffer, uint32_t value) {
+		bigEndian ? buffer.AppendU32BE(value) : buffer.AppendU32(value);
+	};
+
+	const auto sectionCount = static_cast<uint32_t>(sections.size());
+	if (sectionCount == 0u) {
+		// The section headers must begin within the file, so a file without any can't be loaded
+		std::cerr << "Granny file must have at least one section" << std::endl;
+		return false;
+	}
+	std::unique_ptr<SectionWork[]> work(new SectionWork[sectionCount]);
+	std::vector<StreamJob> jobs;
+	std::vector<uint32_t> order(sectionCount);
+	std::iota(order.begin(), order.end(), 0u);
+	// As with decoding, the largest sections go first, so the small ones fill in around them at the end. A
+	// section's streams are queued together, so its tokens are held only briefly.
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs) {
+		return sections[lhs].size > sections[rhs].size;
+	});
+	for (const auto sectionIdx : order) {
+		const auto& section = sections[sectionIdx];
+		auto& sectionWork = work[sectionIdx];
+		if ((section.alignment > GrannyFile::MaxSectionAlignment) || (section.alignment & (section.alignment - 1))) {
+			std::cerr << Formatted("Granny section %d alignment (%x) is invalid", sectionIdx, section.alignment) << std::endl;
+			return false;
+		}
+		sectionWork.data = section.data;
+		for (const auto& marshal : section.marshalling) {
+			if ((marshal.elementSize > 8u) || (marshal.elementSize & (marshal.elementSize - 1)) ||
+					((marshal.offset + (static_cast<uint64_t>(marshal.count) * marshal.elementSize)) > section.size)) {
+				std::cerr << Formatted("Granny section %d marshalling (%x + %d elements of %d bytes) is invalid", sectionIdx, marshal.offset, marshal.count, marshal.elementSize) << std::endl;
+				return false;
+			} else if (bigEndian != GrannyFile::HostBigEndian) {
+				if (sectionWork.swapped.empty()) {
+					sectionWork.swapped.assign(section.data, section.data + section.size);
+					sectionWork.data = sectionWork.swapped.data();
+				}
+				ByteSwap::Swap(&sectionWork.swapped[marshal.offset], marshal.count, marshal.elementSize);
+			}
+		}
+		// Checked as GrannyFile::LoadFixups will, so that nothing is written which can't be loaded
+		for (const auto& reloc : section.relocations) {
+			if ((reloc.offset > section.size) || ((section.size - reloc.offset) < GrannyFile::PointerSize)) {
+				std::cerr << Formatted("Granny section %d relocation lies beyond the section (%x)", sectionIdx, reloc.offset) << std::endl;
+				return false;
+			} else if ((reloc.targetSection >= sectionCount) || (reloc.targetOffset > sections[reloc.targetSection].size)) {
+				std::cerr << Formatted("Granny section %d relocation targets an invalid location (section %d + %x)", sectionIdx, reloc.targetSection, reloc.targetOffset) << std::endl;
+				return false;
+			}
+		}
+		sectionWork.header.encoding = GrannySectionHeader::Encoding::Raw;
+		sectionWork.header.memSize = section.size;
+		sectionWork.header.alignment = section.alignment;
+		sectionWork.pendingStreams = 0u;
+		if (!section.compress || (section.size <= GrannyFile::Oodle1HeadersSize)) {
+			continue;
+		}
+		const auto stops = PlanStreamStops(section.size, options.minStreamSize);
+		sectionWork.header.stream0Stop = stops[0];
+		sectionWork.header.stream1Stop = stops[1];
+		sectionWork.streamOffsets = { 0u, stops[0], stops[1], section.size };
+		for (auto streamIdx = 0u; streamIdx < GrannyFile::Oodle1StreamCount; streamIdx++) {
+			if (sectionWork.streamOffsets[streamIdx + 1] > sectionWork.streamOffsets[streamIdx]) {
+				jobs.push_back({ sectionIdx, streamIdx });
+				sectionWork.pendingStreams++;
+			}
+		}
+	}
+
+	const auto encodeSection = [&](Oodle::Oodle1Compressor& compressor, uint32_t sectionIdx) {
+		const auto& section = sections[sectionIdx];
+		auto& sectionWork = work[sectionIdx];
+		const auto data = sectionWork.data;
+		std::array<uint32_t,GrannyFile::Oodle1HeadersSize / 4> headers = { 0u };
+		for (auto streamIdx = 0u; streamIdx < GrannyFile::Oodle1StreamCount; streamIdx++) {
+			auto& tokens = sectionWork.tokens[streamIdx];
+			if (sectionWork.streamOffsets[streamIdx + 1] > sectionWork.streamOffsets[streamIdx]) {
+				if (!compressor.Compress(&data[sectionWork.streamOffsets[streamIdx]], tokens, &headers[streamIdx * Oodle::Oodle1Compressor::HeaderWords])) {
+					return false;
+				}
+			}
+			std::vector<Oodle::Oodle1Compressor::Token>().swap(tokens);
+		}
+		const auto bitstream = compressor.Finish();
+		if ((GrannyFile::Oodle1HeadersSize + bitstream.size()) >= section.size) {
+			return true;
+		}
+		Buffer payload;
+		for (const auto word : headers) {
+			appendU32(payload, word);
+		}
+		payload.Append(bitstream, false);
+		sectionWork.payload = std::move(payload.bytes);
+		sectionWork.header.encoding = GrannySectionHeader::Encoding::Oodle1;
+		return true;
+	};
+
+	std::atomic<size_t> nextJobIdx(0u);
+	std::atomic<bool> failed(false);
+	const auto worker = [&]() {
+		// Compressors are large, and are reused for every section this thread encodes
+		auto compressor = std::make_unique<Oodle::Oodle1Compressor>(options.level);
+		while (!failed) {
+			const auto jobIdx = nextJobIdx++;
+			if (jobIdx >= jobs.size()) {
+				break;
+			}
+			const auto& job = jobs[jobIdx];
+			auto& sectionWork = work[job.sectionIdx];
+			const auto streamStart = sectionWork.streamOffsets[job.streamIdx];
+			const auto streamLength = sectionWork.streamOffsets[job.streamIdx + 1] - streamStart;
+			Oodle::Oodle1Compressor::Parse(&sectionWork.data[streamStart], streamLength, options.level, sectionWork.tokens[job.streamIdx]);
+			// The streams share one bitstream, and so are entropy-coded together, once they've all been parsed
+			if ((--sectionWork.pendingStreams == 0u) && !encodeSection(*compressor, job.sectionIdx)) {
+				std::cerr << Formatted("Granny section %d could not be compressed", job.sectionIdx) << std::endl;
+				failed = true;
+			}
+		}
+	};
+	const auto threadCount = std::min<size_t>(std::max(options.threads, 1u), jobs.size());
+	std::vector<std::thread> workers;
+	for (auto threadIdx = 1u; threadIdx < threadCount; threadIdx++) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto& thread : workers) {
+		thread.join();
+	}
+	if (failed) {
+		return false;
+	}
+
+	// Lay out the file: primary header, section headers, then each section's data and fixup tables
+	const auto totalHeaderSize = GrannyFile::PrimaryHeaderSize + (sectionCount * GrannyFile::SectionHeaderSize);
+	const auto align = [](size_t offset) {
+		return (offset + SectionFileAlignment - 1) & ~static_cast<size_t>(SectionFileAlignment - 1);
+	};
+	size_t fileOffset = totalHeaderSize;
+	for (auto sectionIdx = 0u; sectionIdx < sectionCount; sectionIdx++) {
+		auto& header = work[sectionIdx].header;
+		fileOffset = align(fileOffset);
+		header.fileOffset = static_cast<uint32_t>(fileOffset);
+		header.fileSize = (header.encoding == GrannySectionHeader::Encoding::Raw) ? header.memSize : static_cast<uint32_t>(work[sectionIdx].payload.size());
+		fileOffset = align(fileOffset + header.fileSize);
+		header.relocOffset = static_cast<uint32_t>(fileOffset);
+		header.relocCount = static_cast<uint32_t>(sections[sectionIdx].relocations.size());
+		fileOffset += header.relocCount * static_cast<size_t>(GrannyFile::RelocationSize);
+		header.marshalOffset = static_cast<uint32_t>(fileOffset);
+		header.marshalCount = static_cast<uint32_t>(sections[sectionIdx].marshalling.size());
+		fileOffset += header.marshalCount * static_cast<size_t>(GrannyFile::MarshallingSize);
+	}
+	if (fileOffset > UINT32_MAX) {
+		std::cerr << Formatted("Granny file would be too large (%zx bytes)", fileOffset) << std::endl;
+		return false;
+	}
+
+	Buffer file;
+	file.bytes.reserve(fileOffset);
+	file.Append(bigEndian ? GrannyFile::SignatureBE : GrannyFile::SignatureLE);
+	appendU32(file, totalHeaderSize);
+	file.AppendPadding(FileInfoOffset - file.Size());
+	appendU32(file, FileVersion);
+	appendU32(file, static_cast<uint32_t>(fileOffset));
+	const auto crcOffset = file.Size();
+	appendU32(file, 0u);
+	appendU32(file, GrannyFile::PrimaryHeaderSize - FileInfoOffset);
+	appendU32(file, sectionCount);
+	bigEndian ? file.AppendU64BE(rootNodeType) : file.AppendU64(rootNodeType);
+	bigEndian ? file.AppendU64BE(rootNodeObject) : file.AppendU64(rootNodeObject);
+	appendU32(file, userTag);
+	file.Append(userData);
+	for (auto sectionIdx = 0u; sectionIdx < sectionCount; sectionIdx++) {
+		const auto& header = work[sectionIdx].header;
+		for (const auto value : { static_cast<uint32_t>(header.encoding), header.fileOffset, header.fileSize, header.memSize, header.alignment,
+				header.stream0Stop, header.stream1Stop, header.relocOffset, header.relocCount, header.marshalOffset, header.marshalCount }) {
+			appendU32(file, value);
+		}
+	}
+	for (auto sectionIdx = 0u; sectionIdx < sectionCount; sectionIdx++) {
+		const auto& header = work[sectionIdx].header;
+		file.AppendPadding(header.fileOffset - file.Size());
+		if (header.encoding == GrannySectionHeader::Encoding::Raw) {
+			file.bytes.insert(file.bytes.end(), work[sectionIdx].data, work[sectionIdx].data + header.fileSize);
+		} else {
+			file.Append(work[sectionIdx].payload, false);
+		}
+		file.AppendPadding(header.relocOffset - file.Size());
+		for (const auto& reloc : sections[sectionIdx].relocations) {
+			appendU32(file, reloc.offset);
+			appendU32(file, reloc.targetSection);
+			appendU32(file, reloc.targetOffset);
+		}
+		for (const auto& marshal : sections[sectionIdx].marshalling) {
+			appendU32(file, marshal.offset);
+			appendU32(file, marshal.count);
+			appendU32(file, marshal.elementSize);
+		}
+	}
+
+	// The CRC covers everything from the section headers onwards
+	const auto crc = Crc32::Update(file.Data() + GrannyFile::PrimaryHeaderSize, file.Size() - GrannyFile::PrimaryHeaderSize);
+	for (auto byteIdx = 0u; byteIdx < 4u; byteIdx++) {
+		const auto shift = bigEndian ? ((3u - byteIdx) * 8u) : (byteIdx * 8u);
+		file.bytes[crcOffset + byteIdx] = static_cast<uint8_t>(crc >> shift);
+	}
+	output = std::move(file.bytes);
+	return true;
+}
@@ -0,0 +1,77 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#ifndef GRANNYWRITER_H
+#define GRANNYWRITER_H
+
+#include <array>
+#include <cstdint>
+#include <oodle/Oodle1Compressor.h>
+#include <vector>
+#include "Granny.h"
+
+struct GrannyWriteOptions {
+	Oodle::Oodle1Level level = Oodle::Oodle1Level::Normal;
+	// Parse up to this many streams at once; each section is entropy-coded by whichever thread finishes
+	// parsing its last stream
+	unsigned threads = 1u;
+	// Sections are split into as many as three equal streams of at least this many bytes. More streams can be
+	// compressed and decoded in parallel, but can't refer back to each other's bytes.
+	uint32_t minStreamSize = 0x10000u;
+};
+
+struct GrannyWriter {
+public:
+	struct Section {
+		const uint8_t *data = nullptr;		// Must remain valid until Write has returned
+		uint32_t size = 0u;
+		uint32_t alignment = 4u;
+		bool compress = true;				// Sections which don't shrink are stored raw regardless
+		std::vector<GrannyRelocation> relocations;
+		// Runs of the data (which is in the host's order) to store in the file's byte order
+		std::vector<GrannyMarshalling> marshalling;
+	};
+
+	uint64_t rootNodeType = 0u;
+	uint64_t rootNodeObject = 0u;
+	uint32_t userTag = 0u;
+	std::array<uint8_t,GrannyFile::UserDataSize> userData = { 0 };
+	bool bigEndian = false;				// Write the headers, tables and marshalled runs big-endian
+	std::vector<Section> sections;
+
+	GrannyWriter() = default;
+
+	// Writes a complete file, headers, section table, relocations, marshalling and CRC included
+	bool Write(std::vector<uint8_t>& output, const GrannyWriteOptions& options = GrannyWriteOptions()) const;
+
+private:
+	// The stream0Stop and stream1Stop to use for a section of this size. The streams are cut into equal thirds
+	// on purpose, rather than at points chosen from the parse: a stream's decode time follows its output length,
+	// so equal streams keep parallel and interleaved decodes balanced, and the stops must be known before the
+	// streams can be parsed in parallel at all. No repeat can cross a stop either way, since each stream starts
+	// with an empty window.
+	static std::array<uint32_t,2> PlanStreamStops(uint32_t size, uint32_t minStreamSize);
+};
+
+#endif
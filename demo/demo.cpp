@@ -22,34 +22,182 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 //
 // For more information, please refer to <https://unlicense.org>
+#include <algorithm>
+#include <fcntl.h>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include "BatchConverter.h"
+#include "Format.h"
 #include "Granny.h"
+#include "GrannyWriter.h"
+
+// Re-encodes a loaded file, with every section compressed afresh
+static bool Recompress(GrannyFile& granny, std::vector<uint8_t>& output, unsigned threads) {
+	GrannyWriter writer;
+	writer.rootNodeType = granny.GetRootNodeType();
+	writer.rootNodeObject = granny.GetRootNodeObject();
+	writer.userTag = granny.GetUserTag();
+	writer.userData = granny.GetUserData();
+	writer.bigEndian = granny.IsBigEndian();
+	for (auto sectionIdx = 0u; sectionIdx < granny.GetSectionCount(); sectionIdx++) {
+		const auto& header = granny.GetSectionHeader(sectionIdx);
+		GrannyWriter::Section section;
+		section.data = granny.GetSection(sectionIdx);
+		section.size = header.memSize;
+		section.alignment = header.alignment;
+		section.relocations = granny.GetSectionRelocations(sectionIdx);
+		section.marshalling = granny.GetSectionMarshalling(sectionIdx);
+		writer.sections.push_back(section);
+	}
+	GrannyWriteOptions options;
+	options.threads = threads;
+	return writer.Write(output, options);
+}
+
+static void PrintStats(const GrannyFile& granny) {
+	for (auto sectionIdx = 0u; sectionIdx < granny.GetSectionCount(); sectionIdx++) {
+		if (granny.GetSectionHeader(sectionIdx).encoding != GrannySectionHeader::Encoding::Oodle1) {
+			continue;
+		}
+		const auto& stats = granny.GetSectionStats(sectionIdx);
+		const auto decoders = stats.Decoders();
+		std::cerr << Formatted("Section %u: %llu bytes, %llu literals, %llu repeats (%llu bytes), %llu escapes (%llu probationary, %llu new), "
+				"%llu renormalizations, %llu decays, %.2f average scan depth, %.3f bytes/cycle",
+				sectionIdx, static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.literals),
+				static_cast<unsigned long long>(stats.repeats), static_cast<unsigned long long>(stats.repeatBytes),
+				static_cast<unsigned long long>(decoders.escapes), static_cast<unsigned long long>(decoders.probationaryHits),
+				static_cast<unsigned long long>(decoders.newSymbols), static_cast<unsigned long long>(decoders.renormalizations),
+				static_cast<unsigned long long>(decoders.decays), decoders.AverageScanDepth(), stats.BytesPerCycle()) << std::endl;
+	}
+}
+
+// Converts a whole directory, as single files are converted below, with every file read, decoded and written
+// concurrently with the rest
+static int ConvertDirectory(const std::string& input, const std::string& output, bool recompress, const GrannyLoadOptions& options,
+		const BatchOptions& batchOptions) {
+	BatchConverter converter([&](const uint8_t *raw, size_t size, std::vector<uint8_t>& converted) {
+		GrannyFile granny;
+		if (!granny.LoadFromBytes(raw, size, options)) {
+			return false;
+		}
+		if (recompress) {
+			// Files are already being converted in parallel
+			return Recompress(granny, converted, 1u);
+		}
+		converted.assign(granny.GetData(), granny.GetData() + granny.GetDataSize());
+		return true;
+	}, batchOptions);
+	BatchStats stats;
+	if (!converter.Run(input, output, stats)) {
+		std::cerr << "Can't read from input directory" << std::endl;
+		return -1;
+	}
+	for (const auto& failure : stats.failures) {
+		std::cerr << failure << std::endl;
+	}
+	const auto seconds = (stats.seconds > 0.0) ? stats.seconds : 1e-9;
+	std::cerr << Formatted("Converted %zu of %zu files in %.2fs: %.1f MiB read (%.1f MiB/s), %.1f MiB written (%.1f MiB/s), "
+			"%.0f files/s, with %s I/O", stats.files - stats.failures.size(), stats.files, stats.seconds,
+			stats.inputBytes / 1048576.0, stats.inputBytes / 1048576.0 / seconds, stats.outputBytes / 1048576.0,
+			stats.outputBytes / 1048576.0 / seconds, (stats.files - stats.failures.size()) / seconds,
+			stats.asyncIo ? "io_uring" : "synchronous") << std::endl;
+	return stats.failures.empty() ? 0 : -1;
+}
 
 int main(int argc, char *argv[]) {
+	auto recompress = false;
+	auto batch = false;
+	BatchOptions batchOptions;
+	batchOptions.convertThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	GrannyLoadOptions options;
+	std::unique_ptr<GrannyCache> cache;
+	while ((argc > 1) && (argv[1][0] == '-')) {
+		const std::string flag(argv[1]);
+		if (flag == "-b") {
+			batch = true;
+		} else if ((flag == "-d") && (argc > 2)) {
+			cache.reset(new GrannyCache(argv[2]));
+			options.cache = cache.get();
+			argc--;
+			argv++;
+		} else if (flag == "-c") {
+			recompress = true;
+		} else if ((flag == "-j") && (argc > 2)) {
+			batchOptions.convertThreads = std::max(std::stoi(argv[2]), 1);
+			argc--;
+			argv++;
+		} else if ((flag == "-m") && (argc > 2)) {
+			batchOptions.memoryLimit = static_cast<size_t>(std::stoull(argv[2])) << 20;
+			argc--;
+			argv++;
+		} else if (flag == "-s") {
+			options.collectStats = true;
+		} else if (flag == "-v") {
+			options.verifyCrc = true;
+		} else {
+			break;
+		}
+		argc--;
+		argv++;
+	}
 	if (argc < 3) {
-		std::cerr << "Usage: oodle1demo <input filename> <output filename>" << std::endl;
+		std::cerr << "Usage: oodle1demo [-c] [-d <directory>] [-s] [-v] <input filename> <output filename>" << std::endl;
+		std::cerr << "       oodle1demo -b [-c] [-d <directory>] [-j <threads>] [-m <MiB>] [-v] <input directory> <output directory>" << std::endl;
+		std::cerr << "  -b  Convert every file in a directory tree, into the same tree under the output directory" << std::endl;
+		std::cerr << "  -c  Write a recompressed Granny file, rather than the decompressed data" << std::endl;
+		std::cerr << "  -d  Keep decoded data in this cache directory, and load it from there when it's already cached" << std::endl;
+		std::cerr << "  -j  Convert this many files at once, in batch mode (by default, one per CPU)" << std::endl;
+		std::cerr << "  -m  Keep at most about this much input and output in memory, in batch mode (by default, 256)" << std::endl;
+		std::cerr << "  -s  Print each Oodle1 section's decode statistics" << std::endl;
+		std::cerr << "  -v  Verify the file's CRC while decompressing it" << std::endl;
 		return 0;
 	}
-	std::ifstream file(argv[1], std::ios::binary | std::ios::ate);
-	if (!file.is_open()) {
+	if (batch) {
+		return ConvertDirectory(argv[1], argv[2], recompress, options, batchOptions);
+	}
+	// The input is mapped rather than read, since the decompressor never needs a copy of it
+	const auto fd = open(argv[1], O_RDONLY);
+	struct stat st;
+	if ((fd < 0) || (fstat(fd, &st) != 0)) {
 		std::cerr << "Can't read from input file" << std::endl;
 		return -1;
 	}
-	const auto size = file.tellg();
-	file.seekg(0);
-	const auto bytes = std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
-	file.close();
+	const auto size = static_cast<size_t>(st.st_size);
+	const auto mapping = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		std::cerr << "Can't map input file" << std::endl;
+		return -1;
+	}
 
-	GrannyFile granny(bytes);
-	const auto data = granny.GetData();
+	GrannyFile granny(static_cast<const uint8_t*>(mapping), size, options);
+	if (mapping) {
+		munmap(mapping, size);
+	}
 
 	std::ofstream outFile(argv[2], std::ios::binary);
 	if (!outFile.is_open()) {
 		std::cerr << "Can't write to output file" << std::endl;
 		return -1;
 	}
-	outFile.write((const char*)data.data(), data.size());
+	if (options.collectStats) {
+		PrintStats(granny);
+	}
+	if (recompress) {
+		std::vector<uint8_t> output;
+		if (!Recompress(granny, output, std::thread::hardware_concurrency())) {
+			return -1;
+		}
+		outFile.write((const char*)output.data(), output.size());
+	} else {
+		outFile.write((const char*)granny.GetData(), granny.GetDataSize());
+	}
 	outFile.close();
 
 	return 0;
@@ -0,0 +1,359 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <random>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "Granny.h"
+#include "GrannyCache.h"
+#include "GrannyWriter.h"
+
+// Round-trip test of the Granny layer: random files from GrannyWriter are loaded back through each of GrannyFile's
+// paths (serial, parallel and interleaved streams, section threads, caller memory, the cache and lazy GetSection),
+// from either byte order, and must reproduce the data they were written from. A damaged copy of each must fail a
+// load which verifies the CRC, and the writer must refuse fixups which the loader would reject.
+
+namespace {
+
+constexpr auto MaxSectionSize = 0x30000u;
+
+[[noreturn]] void Fail(unsigned iteration, const char *what) {
+	std::fprintf(stderr, "Iteration %u: %s\n", iteration, what);
+	std::abort();
+}
+
+std::vector<uint8_t> SectionData(std::mt19937& rng, size_t size) {
+	static const char *const words[] = { "mesh ", "bone ", "vertex ", "track ", "curve ", "0.0 ", "1.0 ", "\n" };
+	std::vector<uint8_t> data;
+	const auto style = rng() % 4u;
+	while (data.size() < size) {
+		if (style == 0u) {
+			const auto word = words[rng() % 8u];
+			data.insert(data.end(), word, word + std::strlen(word));
+		} else if (style == 1u) {
+			data.push_back(static_cast<uint8_t>(rng()));
+		} else if (style == 2u) {
+			data.insert(data.end(), 1u + (rng() % 300u), static_cast<uint8_t>(rng()));
+		} else if ((data.size() > 4u) && (rng() % 3u)) {
+			const auto offset = 1u + (rng() % data.size());
+			for (auto count = 2u + (rng() % 200u); count && (data.size() < size); count--) {
+				data.push_back(data[data.size() - offset]);
+			}
+		} else {
+			data.push_back(static_cast<uint8_t>(rng() % 40u));
+		}
+	}
+	data.resize(size);
+	return data;
+}
+
+struct TestFile {
+	std::vector<std::vector<uint8_t>> sections;		// As given to the writer, in the host's order
+	GrannyWriter writer;
+	std::vector<uint8_t> bytes;
+};
+
+void MakeFile(std::mt19937& rng, unsigned iteration, TestFile& file) {
+	const auto sectionCount = 1u + (rng() % 5u);
+	for (auto sectionIdx = 0u; sectionIdx < sectionCount; sectionIdx++) {
+		file.sections.push_back(SectionData(rng, (rng() % 4u) ? (rng() % MaxSectionSize) : (rng() % 64u)));
+	}
+	auto& writer = file.writer;
+	writer.rootNodeType = (static_cast<uint64_t>(rng()) << 32) | rng();
+	writer.rootNodeObject = rng();
+	writer.userTag = rng();
+	writer.userData[rng() % GrannyFile::UserDataSize] = static_cast<uint8_t>(rng());
+	writer.bigEndian = (rng() & 1u) != 0;
+	for (auto sectionIdx = 0u; sectionIdx < sectionCount; sectionIdx++) {
+		const auto& data = file.sections[sectionIdx];
+		GrannyWriter::Section section;
+		section.data = data.data();
+		section.size = static_cast<uint32_t>(data.size());
+		// Now and then the largest alignment, which mmap alone doesn't give cache entries
+		section.alignment = (rng() % 8u) ? (4u << (rng() % 3u)) : GrannyFile::MaxSectionAlignment;
+		section.compress = (rng() % 5u) != 0;
+		for (uint32_t offset = 0u; rng() % 8u; ) {
+			const auto elementSize = 1u << (rng() % 4u);
+			offset = (offset + (rng() % 64u) + elementSize - 1u) & ~(elementSize - 1u);
+			const auto count = static_cast<uint32_t>(rng() % 2000u);
+			if ((offset + (static_cast<uint64_t>(count) * elementSize)) > data.size()) {
+				break;
+			}
+			section.marshalling.push_back({ offset, count, elementSize });
+			offset += count * elementSize;
+		}
+		for (auto count = (data.size() >= GrannyFile::PointerSize) ? (rng() % 40u) : 0u; count; count--) {
+			const auto target = static_cast<uint32_t>(rng() % sectionCount);
+			section.relocations.push_back({ static_cast<uint32_t>(rng() % (data.size() - GrannyFile::PointerSize + 1u)), target,
+					static_cast<uint32_t>(rng() % (file.sections[target].size() + 1u)) });
+		}
+		writer.sections.push_back(section);
+	}
+	GrannyWriteOptions options;
+	options.level = static_cast<Oodle::Oodle1Level>(rng() % 3u);
+	options.threads = 1u + (rng() % 4u);
+	options.minStreamSize = 1u + (rng() % 0x10000u);
+	if (!writer.Write(file.bytes, options)) {
+		Fail(iteration, "GrannyWriter failed to write the file");
+	}
+}
+
+// The section as a load presents it: relocated pointers hold their targets' offsets within GetData
+std::vector<uint8_t> Expected(const TestFile& file, const GrannyFile& granny, uint32_t sectionIdx, GrannyRelocationMode relocation) {
+	auto expected = file.sections[sectionIdx];
+	if (relocation == GrannyRelocationMode::Offsets) {
+		for (const auto& reloc : file.writer.sections[sectionIdx].relocations) {
+			const auto target = static_cast<uint32_t>(granny.GetSectionOffset(reloc.targetSection) + reloc.targetOffset);
+			std::memcpy(&expected[reloc.offset], &target, sizeof(target));
+		}
+	}
+	return expected;
+}
+
+void CheckData(unsigned iteration, const TestFile& file, const GrannyFile& granny, const uint8_t *data, GrannyRelocationMode relocation,
+		const char *path) {
+	const auto& writer = file.writer;
+	if ((granny.GetSectionCount() != file.sections.size()) || (granny.IsBigEndian() != writer.bigEndian) ||
+			(granny.GetRootNodeType() != writer.rootNodeType) || (granny.GetRootNodeObject() != writer.rootNodeObject) ||
+			(granny.GetUserTag() != writer.userTag) || (granny.GetUserData() != writer.userData)) {
+		Fail(iteration, "The loaded headers don't match those written");
+	}
+	for (auto sectionIdx = 0u; sectionIdx < file.sections.size(); sectionIdx++) {
+		const auto offset = granny.GetSectionOffset(sectionIdx);
+		const auto expected = Expected(file, granny, sectionIdx, relocation);
+		if ((offset % writer.sections[sectionIdx].alignment) || (granny.GetSectionSize(sectionIdx) != expected.size()) ||
+				(!expected.empty() && (std::memcmp(data + offset, expected.data(), expected.size()) != 0))) {
+			std::fprintf(stderr, "Section %u of %zu differs, loaded %s\n", sectionIdx, file.sections.size(), path);
+			Fail(iteration, "A loaded section doesn't match the data written");
+		}
+	}
+}
+
+void Load(unsigned iteration, const TestFile& file, const GrannyLoadOptions& options, const char *path) {
+	GrannyFile granny;
+	if (!granny.LoadFromBytes(file.bytes.data(), file.bytes.size(), options)) {
+		std::fprintf(stderr, "Loading %s failed\n", path);
+		Fail(iteration, "A written file failed to load");
+	}
+	if (reinterpret_cast<uintptr_t>(granny.GetData()) % granny.GetDataAlignment()) {
+		Fail(iteration, "The loaded data isn't aligned as its sections ask");
+	}
+	CheckData(iteration, file, granny, granny.GetData(), options.relocation, path);
+}
+
+std::set<ino_t> CacheEntries(const std::string& directory) {
+	std::set<ino_t> entries;
+	if (const auto dir = opendir(directory.c_str())) {
+		while (const auto entry = readdir(dir)) {
+			struct stat st;
+			if ((entry->d_name[0] != '.') && (stat((directory + "/" + entry->d_name).c_str(), &st) == 0)) {
+				entries.insert(st.st_ino);
+			}
+		}
+		closedir(dir);
+	}
+	return entries;
+}
+
+void RemoveDirectory(const std::string& directory) {
+	if (const auto dir = opendir(directory.c_str())) {
+		while (const auto entry = readdir(dir)) {
+			if (entry->d_name[0] != '.') {
+				unlink((directory + "/" + entry->d_name).c_str());
+			}
+		}
+		closedir(dir);
+	}
+	rmdir(directory.c_str());
+}
+
+void RunIteration(std::mt19937& rng, unsigned iteration, const std::string& cacheDirectory) {
+	TestFile file;
+	MakeFile(rng, iteration, file);
+	const auto relocation = (rng() & 1u) ? GrannyRelocationMode::Offsets : GrannyRelocationMode::None;
+	const auto verifyCrc = (rng() & 1u) != 0;
+
+	GrannyLoadOptions serial;
+	serial.relocation = relocation;
+	serial.verifyCrc = verifyCrc;
+	Load(iteration, file, serial, "serially");
+	auto threaded = serial;
+	threaded.sectionThreads = 1u + (rng() % 4u);
+	Load(iteration, file, threaded, "with section threads");
+
+	// Parallel streams need the starts recorded by an earlier load
+	GrannyFile first;
+	if (!first.LoadFromBytes(file.bytes.data(), file.bytes.size(), serial)) {
+		Fail(iteration, "A written file failed to load");
+	}
+	auto parallel = threaded;
+	parallel.parallelStreams = true;
+	parallel.streamStarts = first.GetStreamStarts();
+	Load(iteration, file, parallel, "with parallel streams");
+	parallel.interleaveStreams = true;
+	Load(iteration, file, parallel, "with interleaved streams");
+
+	// Default starts, as a section that no serial load decoded has, must fall back to a serial decode. Garbage
+	// starts mustn't crash the decode, and once the CRC is verified, mustn't load the wrong data either
+	auto defaults = parallel;
+	defaults.interleaveStreams = (rng() & 1u) != 0;
+	defaults.streamStarts.assign(file.sections.size(), GrannyStreamStarts());
+	Load(iteration, file, defaults, "with default stream starts");
+	auto garbage = defaults;
+	garbage.streamStarts = first.GetStreamStarts();
+	garbage.verifyCrc = true;
+	for (auto& starts : garbage.streamStarts) {
+		for (auto& start : starts) {
+			if (rng() & 1u) {
+				start.inputOffset = rng() % (2u * MaxSectionSize);
+				start.sr = (rng() & 1u) ? rng() : (rng() % 0x100u);
+				start.srModulus = (rng() % 4u) ? (rng() >> (rng() % 32u)) : 0u;
+				start.lsb = static_cast<uint8_t>(rng() % 3u);
+			}
+		}
+	}
+	GrannyFile garbled;
+	if (garbled.LoadFromBytes(file.bytes.data(), file.bytes.size(), garbage)) {
+		CheckData(iteration, file, garbled, garbled.GetData(), garbage.relocation, "with garbage stream starts");
+	}
+
+	GrannyFile caller;
+	if (!caller.LoadHeaders(file.bytes.data(), file.bytes.size())) {
+		Fail(iteration, "A written file's headers failed to load");
+	}
+	std::vector<uint8_t> memory(caller.GetDataSize() + GrannyFile::MaxSectionAlignment + (rng() % 1024u));
+	const auto offset = (GrannyFile::MaxSectionAlignment - (reinterpret_cast<uintptr_t>(memory.data()) % GrannyFile::MaxSectionAlignment)) %
+			GrannyFile::MaxSectionAlignment;
+	if (!caller.Decompress(&memory[offset], memory.size() - offset, threaded)) {
+		Fail(iteration, "A written file failed to decompress into caller memory");
+	}
+	CheckData(iteration, file, caller, &memory[offset], relocation, "into caller memory");
+
+	// The first load through the cache adds the file (unless it holds no data at all); the next must map that entry
+	// back in rather than replace it
+	GrannyCache cache(cacheDirectory);
+	auto cached = serial;
+	cached.cache = &cache;
+	Load(iteration, file, cached, "through an empty cache");
+	const auto entries = CacheEntries(cacheDirectory);
+	if (entries.empty() && first.GetDataSize()) {
+		Fail(iteration, "Loading through the cache added nothing to it");
+	}
+	Load(iteration, file, cached, "from the cache");
+	if (CacheEntries(cacheDirectory) != entries) {
+		Fail(iteration, "Loading a cached file replaced its entry, rather than using it");
+	}
+
+	// Lazily decompressed sections are marshalled, but never relocated
+	for (const auto lazyCache : { static_cast<GrannyCache*>(nullptr), &cache }) {
+		GrannyFile lazy;
+		if (!lazy.LoadHeaders(file.bytes.data(), file.bytes.size())) {
+			Fail(iteration, "A written file's headers failed to load");
+		}
+		lazy.SetCache(lazyCache);
+		lazy.SetResidentLimit(rng() % MaxSectionSize);
+		for (auto count = 2u * file.sections.size(); count; count--) {
+			const auto sectionIdx = static_cast<uint32_t>(rng() % file.sections.size());
+			const auto& expected = file.sections[sectionIdx];
+			if (expected.empty()) {
+				continue;
+			}
+			const auto section = lazy.GetSection(sectionIdx);
+			if (!section || (std::memcmp(section, expected.data(), expected.size()) != 0)) {
+				Fail(iteration, "A lazily decompressed section doesn't match the data written");
+			}
+		}
+		if (!lazy.VerifyCrc()) {
+			Fail(iteration, "A written file's CRC doesn't match");
+		}
+	}
+	RemoveDirectory(cacheDirectory);
+	mkdir(cacheDirectory.c_str(), 0700);
+
+	// The writer must refuse a relocation or marshalling run which the loader would reject
+	auto invalid = file.writer;
+	auto& invalidSection = invalid.sections[rng() % invalid.sections.size()];
+	const auto invalidSize = invalidSection.size;
+	switch (rng() % 4u) {
+		case 0u: invalidSection.relocations.push_back({ invalidSize - static_cast<uint32_t>(rng() % GrannyFile::PointerSize), 0u, 0u }); break;
+		case 1u: invalidSection.relocations.push_back({ 0u, static_cast<uint32_t>(invalid.sections.size()), 0u }); break;
+		case 2u: invalidSection.relocations.push_back({ 0u, 0u, invalid.sections[0].size + 1u + static_cast<uint32_t>(rng() % 64u) }); break;
+		default: invalidSection.marshalling.push_back({ invalidSize, 1u, 1u }); break;
+	}
+	std::vector<uint8_t> invalidBytes;
+	if (invalid.Write(invalidBytes)) {
+		Fail(iteration, "GrannyWriter wrote a file with an invalid relocation or marshalling run");
+	}
+
+	// Anything after the primary header is covered by the CRC
+	auto damaged = file.bytes;
+	damaged[GrannyFile::PrimaryHeaderSize + (rng() % (damaged.size() - GrannyFile::PrimaryHeaderSize))] ^= static_cast<uint8_t>(1u << (rng() % 8u));
+	for (const auto sectionThreads : { 1u, 3u }) {
+		GrannyLoadOptions options;
+		options.verifyCrc = true;
+		options.sectionThreads = sectionThreads;
+		GrannyFile granny;
+		if (granny.LoadHeaders(damaged.data(), damaged.size()) && granny.Decompress(options)) {
+			Fail(iteration, "A damaged file passed CRC verification");
+		}
+	}
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	auto iterations = 100u;
+	auto seed = 1u;
+	for (auto argIdx = 1; argIdx < argc; argIdx++) {
+		const std::string arg(argv[argIdx]);
+		if ((arg == "--iterations") && ((argIdx + 1) < argc)) {
+			iterations = static_cast<unsigned>(std::stoul(argv[++argIdx]));
+		} else if ((arg == "--seed") && ((argIdx + 1) < argc)) {
+			seed = static_cast<unsigned>(std::stoul(argv[++argIdx]));
+		} else {
+			std::fprintf(stderr, "Usage: granny_roundtrip [--iterations <count>] [--seed <seed>]\n");
+			return 0;
+		}
+	}
+	char cacheDirectory[] = "/tmp/granny_roundtrip.XXXXXX";
+	if (!mkdtemp(cacheDirectory)) {
+		std::fprintf(stderr, "Can't create a cache directory\n");
+		return 1;
+	}
+	std::mt19937 rng(seed);
+	for (auto iteration = 0u; iteration < iterations; iteration++) {
+		RunIteration(rng, iteration, cacheDirectory);
+	}
+	RemoveDirectory(cacheDirectory);
+	std::printf("%u files round-tripped\n", iterations);
+	return 0;
+}
@@ -0,0 +1,386 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <oodle/Oodle1.h>
+#include <oodle/Oodle1Compressor.h>
+#include <oodle/Oodle1Reference.h>
+#include <random>
+#include <string>
+#include <vector>
+
+// Differential fuzz target: every input is decoded by the reference engine, and then by each of the optimized
+// paths, which must all agree with it on the output, the error (if any), and where the bitstream was left.
+//
+// An input is laid out as:
+//   12 bytes: the stream's three header words
+//    4 bytes: control; the low 18 bits are the output length, and the rest seed how the optimized decodes
+//             are split into calls, whether they use repeat slack, and how streamed input is chunked
+//   the rest: the bitstream
+//
+// Built with OODLE_LIBFUZZER defined, this is a libFuzzer target. Otherwise main() generates random and
+// mutated inputs itself, or replays the inputs named on its command line.
+
+namespace {
+
+using namespace Oodle;
+
+constexpr auto ControlLengthBits = 18u;
+constexpr auto InputHeaderSize = 16u;
+
+uint32_t ReadU32(const uint8_t *bytes) {
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+bool SameState(const Oodle1Bitstream::State& lhs, const Oodle1Bitstream::State& rhs) {
+	return (lhs.inputOffset == rhs.inputOffset) && (lhs.sr == rhs.sr) && (lhs.srModulus == rhs.srModulus) && (lhs.lsb == rhs.lsb);
+}
+
+struct Decoded {
+	std::vector<uint8_t> output;
+	size_t length = 0u;
+	Oodle1Error error = Oodle1Error::None;
+	Oodle1Bitstream::State state;
+	bool hasState = true;
+};
+
+[[noreturn]] void Mismatch(const char *path, const char *what, const Decoded& expected, const Decoded& actual) {
+	std::fprintf(stderr, "%s disagrees with the reference engine on %s: %zu bytes with error %d, rather than %zu bytes with error %d\n",
+			path, what, actual.length, static_cast<int>(actual.error), expected.length, static_cast<int>(expected.error));
+	std::abort();
+}
+
+void Compare(const char *path, const Decoded& expected, const Decoded& actual) {
+	if ((actual.length != expected.length) || (actual.error != expected.error)) {
+		Mismatch(path, "the length decoded", expected, actual);
+	} else if (std::memcmp(actual.output.data(), expected.output.data(), expected.length) != 0) {
+		Mismatch(path, "the output", expected, actual);
+	} else if (actual.hasState && !SameState(actual.state, expected.state)) {
+		Mismatch(path, "the final bitstream position", expected, actual);
+	}
+}
+
+Decoded DecodeReference(const uint32_t *header, const uint8_t *input, size_t inputLength, size_t length) {
+	Decoded decoded;
+	// A whole token is always written, so the output has room for the longest repeat
+	decoded.output.resize(length + 512u);
+	Oodle1ReferenceBitstream bs(input, inputLength);
+	auto decomp = std::make_unique<Oodle1ReferenceDecompressor>();
+	decomp->Reset(bs, header);
+	while (decoded.length < length) {
+		const auto tokenLength = decomp->Decompress(&decoded.output[decoded.length]);
+		if (!tokenLength) {
+			break;
+		}
+		decoded.length += tokenLength;
+	}
+	decoded.length = std::min(decoded.length, length);
+	decoded.error = decomp->GetError();
+	decoded.state = bs.Save(input);
+	return decoded;
+}
+
+template <typename Policy> Decoded DecodeOptimized(Oodle1Decompressor& decomp, const uint32_t *header, const uint8_t *input, size_t inputLength,
+		size_t length, uint32_t seed) {
+	std::minstd_rand rng(seed);
+	const auto slack = (rng() & 1u) != 0;
+	const auto chunked = (rng() & 1u) != 0;
+	Decoded decoded;
+	// Sized exactly, so that a sanitizer catches any write beyond what was allowed
+	decoded.output.resize(length + (slack ? Oodle1Decompressor::RepeatSlack : 0u));
+	Oodle1Bitstream bs(input, inputLength);
+	decomp.Reset(bs, header);
+	while (decoded.length < length) {
+		const auto chunk = chunked ? std::min<size_t>(length - decoded.length, 1u + (rng() % 1024u)) : (length - decoded.length);
+		const auto produced = decomp.Decompress<Policy>(&decoded.output[decoded.length], chunk, slack);
+		decoded.length += produced;
+		if (produced < chunk) {
+			break;
+		}
+	}
+	decoded.error = decomp.GetError();
+	decoded.state = bs.Save(input);
+	return decoded;
+}
+
+// The same stream in every lane, each with its own slack and split into calls of its own, so that lanes
+// finish (and drop out) at different points in the interleaved loop
+template <typename Policy> std::vector<Decoded> DecodeInterleaved(std::array<std::unique_ptr<Oodle1Decompressor>,Oodle1Decompressor::MaxLanes>& decomps,
+		const uint32_t *header, const uint8_t *input, size_t inputLength, size_t length, uint32_t seed) {
+	std::minstd_rand rng(seed);
+	const auto laneCount = 2u + (rng() % (Oodle1Decompressor::MaxLanes - 1u));
+	std::vector<Decoded> decoded(laneCount);
+	std::vector<Oodle1Bitstream> streams(laneCount, Oodle1Bitstream(input, inputLength));
+	std::vector<Oodle1Lane> lanes(laneCount);
+	std::vector<bool> chunked(laneCount);
+	std::vector<bool> finished(laneCount, false);
+	for (auto laneIdx = 0u; laneIdx < laneCount; laneIdx++) {
+		lanes[laneIdx].decomp = decomps[laneIdx].get();
+		lanes[laneIdx].decomp->Reset(streams[laneIdx], header);
+		lanes[laneIdx].outputSlack = (rng() & 1u) != 0;
+		chunked[laneIdx] = (rng() & 1u) != 0;
+		decoded[laneIdx].output.resize(length + (lanes[laneIdx].outputSlack ? Oodle1Decompressor::RepeatSlack : 0u));
+	}
+	for (;;) {
+		std::vector<Oodle1Lane> active;
+		for (auto laneIdx = 0u; laneIdx < laneCount; laneIdx++) {
+			if (!finished[laneIdx] && (decoded[laneIdx].length < length)) {
+				auto& lane = lanes[laneIdx];
+				lane.output = &decoded[laneIdx].output[decoded[laneIdx].length];
+				lane.length = chunked[laneIdx] ? std::min<size_t>(length - decoded[laneIdx].length, 1u + (rng() % 1024u)) : (length - decoded[laneIdx].length);
+				active.push_back(lane);
+			}
+		}
+		if (active.empty()) {
+			break;
+		}
+		Oodle1Decompressor::DecompressInterleaved<Policy>(active.data(), active.size());
+		for (const auto& lane : active) {
+			const auto laneIdx = static_cast<size_t>(std::find_if(lanes.begin(), lanes.end(), [&](const Oodle1Lane& candidate) {
+				return candidate.decomp == lane.decomp;
+			}) - lanes.begin());
+			decoded[laneIdx].length += lane.decompressed;
+			finished[laneIdx] = (lane.decompressed < lane.length);
+		}
+	}
+	for (auto laneIdx = 0u; laneIdx < laneCount; laneIdx++) {
+		decoded[laneIdx].error = lanes[laneIdx].decomp->GetError();
+		decoded[laneIdx].state = streams[laneIdx].Save(input);
+	}
+	return decoded;
+}
+
+Decoded DecodeStreamed(const uint32_t *header, const uint8_t *input, size_t inputLength, size_t length, uint32_t seed) {
+	std::minstd_rand rng(seed);
+	Decoded decoded;
+	decoded.output.resize(length);
+	decoded.hasState = false;
+	Oodle1StreamDecompressor decomp(header);
+	size_t inputOffset = 0u;
+	auto final = false;
+	while (decoded.length < length) {
+		const uint8_t *output = nullptr;
+		const auto produced = decomp.Decompress(output, length - decoded.length);
+		std::copy(output, output + produced, &decoded.output[decoded.length]);
+		decoded.length += produced;
+		if (produced) {
+			continue;
+		} else if (final || (decomp.GetError() != Oodle1Error::None)) {
+			break;
+		}
+		const auto chunk = std::min<size_t>(inputLength - inputOffset, rng() % 4096u);
+		final = ((inputOffset + chunk) == inputLength);
+		decomp.Feed(input + inputOffset, chunk, final);
+		inputOffset += chunk;
+	}
+	decoded.error = decomp.GetError();
+	return decoded;
+}
+
+// Random reads through a checkpoint index, built from the stream, saved and loaded back, must give the same bytes as
+// decoding from the start. A few checkpoints are enough to start reads from each part of the stream
+void CheckIndex(Oodle1CheckpointIndex& index, const uint32_t *header, const uint8_t *input, size_t inputLength, const Decoded& expected, uint32_t seed) {
+	std::minstd_rand rng(seed);
+	const auto length = expected.length;
+	std::vector<uint8_t> output(length);
+	const auto interval = 1u + (length / 8u) + (rng() % 4096u);
+	if (!index.Build(header, input, inputLength, output.data(), length, interval) || !std::equal(output.begin(), output.end(), expected.output.begin())) {
+		std::fprintf(stderr, "Building a checkpoint index disagrees with the reference engine\n");
+		std::abort();
+	}
+	std::vector<uint8_t> saved;
+	index.Save(saved);
+	if (!index.Load(saved.data(), saved.size())) {
+		std::fprintf(stderr, "A checkpoint index doesn't load back once saved\n");
+		std::abort();
+	}
+	for (auto readIdx = 0u; readIdx < 4u; readIdx++) {
+		const auto offset = rng() % (length + 1u);
+		const auto readLength = rng() % 4096u;
+		std::vector<uint8_t> range(readLength);
+		const auto read = index.Read(input, inputLength, offset, range.data(), readLength);
+		if ((read != std::min<size_t>(readLength, length - offset)) || !std::equal(range.begin(), range.begin() + read, expected.output.begin() + offset)) {
+			std::fprintf(stderr, "Reading %zu bytes at %zu through a checkpoint index disagrees with the reference engine\n", readLength, offset);
+			std::abort();
+		}
+	}
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	if (size < InputHeaderSize) {
+		return 0;
+	}
+	const uint32_t header[3] = { ReadU32(data), ReadU32(data + 4), ReadU32(data + 8) };
+	const auto control = ReadU32(data + 12);
+	const auto length = static_cast<size_t>(control & ((1u << ControlLengthBits) - 1));
+	const auto seed = control >> ControlLengthBits;
+	const auto input = data + InputHeaderSize;
+	const auto inputLength = size - InputHeaderSize;
+
+	static auto decomp = std::make_unique<Oodle1Decompressor>();
+	static std::array<std::unique_ptr<Oodle1Decompressor>,Oodle1Decompressor::MaxLanes> laneDecomps = {
+		std::make_unique<Oodle1Decompressor>(), std::make_unique<Oodle1Decompressor>(),
+		std::make_unique<Oodle1Decompressor>(), std::make_unique<Oodle1Decompressor>(),
+	};
+	const auto expected = DecodeReference(header, input, inputLength, length);
+	Compare("Checked decode", expected, DecodeOptimized<Oodle1Checked>(*decomp, header, input, inputLength, length, seed));
+	Compare("Checked decode with stats", expected, DecodeOptimized<Oodle1WithStats<Oodle1Checked>>(*decomp, header, input, inputLength, length, seed + 1));
+	Compare("Streamed decode", expected, DecodeStreamed(header, input, inputLength, length, seed));
+	for (const auto& lane : DecodeInterleaved<Oodle1Checked>(laneDecomps, header, input, inputLength, length, seed + 3)) {
+		Compare("Checked interleaved decode", expected, lane);
+	}
+	if ((expected.error == Oodle1Error::None) && (expected.length == length)) {
+		static Oodle1CheckpointIndex index;
+		CheckIndex(index, header, input, inputLength, expected, seed + 5);
+	}
+	if (expected.error == Oodle1Error::None) {
+		// Well-formed streams are safe to decode unchecked, which must then agree as well
+		Compare("Unchecked decode", expected, DecodeOptimized<Oodle1Unchecked>(*decomp, header, input, inputLength, length, seed + 2));
+		for (const auto& lane : DecodeInterleaved<Oodle1Unchecked>(laneDecomps, header, input, inputLength, length, seed + 4)) {
+			Compare("Unchecked interleaved decode", expected, lane);
+		}
+	}
+	return 0;
+}
+
+#ifndef OODLE_LIBFUZZER
+
+namespace {
+
+void AppendU32(std::vector<uint8_t>& bytes, uint32_t value) {
+	for (auto byteIdx = 0u; byteIdx < 4u; byteIdx++) {
+		bytes.push_back(static_cast<uint8_t>(value >> (byteIdx * 8)));
+	}
+}
+
+// Arbitrary headers over arbitrary bitstreams; most decode some way before going wrong
+std::vector<uint8_t> RandomInput(std::mt19937& rng) {
+	const auto windowSize = (rng() % 4u) ? (rng() % 0x40000u) : (rng() % 64u);
+	const auto litAlphabetSize = (rng() % 3u) ? 256u : (rng() % 258u);
+	const auto uniqueLits = 1u + (rng() % std::max<uint32_t>(litAlphabetSize, 1u));
+	const auto largest1K = rng() % ((windowSize / 1024u) + 1u);
+	auto repLens = 0u;
+	for (auto groupIdx = 0u; groupIdx < 4u; groupIdx++) {
+		repLens = (repLens << 8) | (rng() % 66u);
+	}
+	std::vector<uint8_t> bytes;
+	AppendU32(bytes, (windowSize << 9) | litAlphabetSize);
+	AppendU32(bytes, (largest1K << 19) | uniqueLits);
+	AppendU32(bytes, repLens);
+	AppendU32(bytes, rng());
+	const auto inputLength = rng() % 20000u;
+	const auto style = rng() % 3u;
+	for (auto idx = 0u; idx < inputLength; idx++) {
+		const auto value = rng();
+		bytes.push_back(static_cast<uint8_t>((style == 0u) ? value : (style == 1u) ? ((value % 7u) ? 0u : (value >> 8)) : (value & 0x0F)));
+	}
+	return bytes;
+}
+
+// A well-formed stream from the compressor, with a few of its bytes (rarely, header bytes too) damaged
+std::vector<uint8_t> MutatedInput(std::mt19937& rng) {
+	// The optimal parse costs several times what the others do, so it's given shorter sources to keep the pace up
+	const auto level = static_cast<Oodle1Level>(rng() % 3u);
+	std::vector<uint8_t> source;
+	const auto sourceLength = rng() % ((level == Oodle1Level::Optimal) ? 0x4000u : 0x20000u);
+	while (source.size() < sourceLength) {
+		if ((source.size() > 4u) && (rng() % 3u)) {
+			const auto offset = 1u + (rng() % source.size());
+			for (auto count = 2u + (rng() % 80u); count && (source.size() < sourceLength); count--) {
+				source.push_back(source[source.size() - offset]);
+			}
+		} else {
+			source.push_back(static_cast<uint8_t>('a' + (rng() % 26u)));
+		}
+	}
+	Oodle1Compressor compressor(level);
+	uint32_t header[Oodle1Compressor::HeaderWords];
+	if (!compressor.Compress(source.data(), source.size(), header)) {
+		return {};
+	}
+	const auto bitstream = compressor.Finish();
+	std::vector<uint8_t> bytes;
+	for (const auto word : header) {
+		AppendU32(bytes, word);
+	}
+	// Sometimes ask for more than was compressed, to run on past the end of the bitstream
+	const auto length = (rng() % 4u) ? sourceLength : (sourceLength + (rng() % 1000u));
+	AppendU32(bytes, (rng() << ControlLengthBits) | std::min<uint32_t>(length, (1u << ControlLengthBits) - 1));
+	bytes.insert(bytes.end(), bitstream.begin(), bitstream.end());
+	for (auto mutations = rng() % 4u; mutations; mutations--) {
+		const auto idx = (rng() % 8u) ? (InputHeaderSize + (rng() % std::max<size_t>(bitstream.size(), 1u))) : (rng() % 12u);
+		if (idx < bytes.size()) {
+			bytes[idx] ^= static_cast<uint8_t>(1u << (rng() % 8u));
+		}
+	}
+	return bytes;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	auto iterations = 1000u;
+	auto seed = 1u;
+	std::vector<std::string> filenames;
+	for (auto argIdx = 1; argIdx < argc; argIdx++) {
+		const std::string arg(argv[argIdx]);
+		if ((arg == "--iterations") && ((argIdx + 1) < argc)) {
+			iterations = static_cast<unsigned>(std::stoul(argv[++argIdx]));
+		} else if ((arg == "--seed") && ((argIdx + 1) < argc)) {
+			seed = static_cast<unsigned>(std::stoul(argv[++argIdx]));
+		} else if (arg.substr(0, 2) == "--") {
+			std::fprintf(stderr, "Usage: oodle1_fuzz [--iterations <count>] [--seed <seed>] [input filenames...]\n");
+			return 0;
+		} else {
+			filenames.push_back(arg);
+		}
+	}
+	if (!filenames.empty()) {
+		for (const auto& filename : filenames) {
+			std::ifstream inFile(filename, std::ios::binary);
+			const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+			LLVMFuzzerTestOneInput(bytes.data(), bytes.size());
+		}
+		std::printf("%zu inputs agreed\n", filenames.size());
+		return 0;
+	}
+	std::mt19937 rng(seed);
+	for (auto iteration = 0u; iteration < iterations; iteration++) {
+		const auto bytes = (iteration & 1u) ? MutatedInput(rng) : RandomInput(rng);
+		LLVMFuzzerTestOneInput(bytes.data(), bytes.size());
+	}
+	std::printf("%u inputs agreed\n", iterations);
+	return 0;
+}
+
+#endif
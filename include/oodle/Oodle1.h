@@ -25,29 +25,68 @@
 #ifndef LIBOODLE_OODLE1_H
 #define LIBOODLE_OODLE1_H
 
+#include <algorithm>
 #include <array>
+#include <bitset>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <type_traits>
 #include <vector>
 
 namespace Oodle {
 
 class Oodle1Bitstream {
 public:
-	explicit Oodle1Bitstream(const uint8_t *input_) : input(input_) {
+	// Everything needed to resume reading from some point in a stream, given the same input
+	struct State {
+		uint64_t inputOffset = 0u;	// Relative to the start of the input
+		uint32_t sr = 0u;
+		uint32_t srModulus = 0u;
+		uint8_t lsb = 0u;
+	};
+
+	// The input must be padded as described in the README; Ingest reads ahead a whole word at a time
+	explicit Oodle1Bitstream(const uint8_t *input_) : input(input_), inputRemaining(SIZE_MAX) {
 		sr = *input >> 1;
 		lsb = *input & 0x01;
 		srModulus = 0x80;
 		input++;
 	}
 
-	void Ingest() {
-		while (srModulus <= 0x800000) {
-			sr = (sr << 1) | lsb;
-			const auto b = *input;
-			sr = (sr << 7) | (b >> 1);
-			lsb = b & 0x01;
-			srModulus <<= 8;
+	// Reads exactly inputLength bytes of input, behaving as though it were followed by zero padding
+	Oodle1Bitstream(const uint8_t *input_, size_t inputLength) : input(input_), inputRemaining(inputLength) {
+		const auto b = inputRemaining ? *input : 0;
+		sr = b >> 1;
+		lsb = b & 0x01;
+		srModulus = 0x80;
+		if (inputRemaining) {
 			input++;
+			inputRemaining--;
+		}
+	}
+
+	// Resumes from a state saved from a bitstream over the same input
+	Oodle1Bitstream(const uint8_t *input_, size_t inputLength, const State& state) :
+			input(input_ + state.inputOffset), inputRemaining(inputLength - state.inputOffset),
+			sr(state.sr), srModulus(state.srModulus), lsb(state.lsb) { }
+
+	State Save(const uint8_t *inputStart) const {
+		State state;
+		state.inputOffset = input - inputStart;
+		state.sr = sr;
+		state.srModulus = srModulus;
+		state.lsb = lsb;
+		return state;
+	}
+
+	size_t InputRemaining() const { return inputRemaining; }
+
+	void Ingest() {
+		if (inputRemaining >= 4) {
+			IngestWord();
+		} else {
+			IngestBytes();
 		}
 	}
 
@@ -83,46 +122,307 @@ public:
 		return z;
 	}
 
+	// Variants for a fixed, power-of-two "one", which replace the (srModulus / one) division with a shift
+	template <uint32_t one> uint32_t Peek() {
+		static_assert(IsPowerOfTwo(one), "Oodle1Bitstream::Peek<one> requires a power-of-two one");
+		Ingest();
+		const auto scale = (srModulus >> Log2(one));
+		const auto z = std::min((sr / scale), one - 1);
+		return z;
+	}
+
+	template <uint32_t one> void Consume(uint32_t minZ, uint32_t spanZ) {
+		static_assert(IsPowerOfTwo(one), "Oodle1Bitstream::Consume<one> requires a power-of-two one");
+		const auto scale = (srModulus >> Log2(one));
+		const auto scaledZ = (minZ * scale);
+		sr -= scaledZ;
+		if (minZ < (one - spanZ)) {
+			srModulus = spanZ * scale;
+		} else {
+			srModulus -= scaledZ;
+		}
+	}
+
+	template <uint32_t one> uint32_t Get() {
+		static_assert(IsPowerOfTwo(one), "Oodle1Bitstream::Get<one> requires a power-of-two one");
+		Ingest();
+		const auto scale = (srModulus >> Log2(one));
+		const auto z = std::min((sr / scale), one - 1);
+		const auto scaledZ = (z * scale);
+		sr -= scaledZ;
+		if (z < (one - 1)) {
+			srModulus = scale;
+		} else {
+			srModulus -= scaledZ;
+		}
+		return z;
+	}
+
 private:
+	static constexpr bool IsPowerOfTwo(uint32_t value) {
+		return value && !(value & (value - 1));
+	}
+
+	static constexpr uint32_t Log2(uint32_t value) {
+		auto bits = 0u;
+		while (value > 1) {
+			value >>= 1;
+			bits++;
+		}
+		return bits;
+	}
+
+	// Shifts in however many bytes (at most three) are needed to bring srModulus above 0x800000, in one step.
+	// Appending bytes with the 7+1 split is equivalent to appending them whole to (sr:lsb), and then
+	// splitting the lowest bit back off into lsb
+	void IngestWord() {
+		const auto byteCount = ((__builtin_clz((srModulus - 1) | 1) + 7) >> 3) - 1;
+		const auto word = (static_cast<uint32_t>(input[0]) << 24) | (static_cast<uint32_t>(input[1]) << 16) |
+				(static_cast<uint32_t>(input[2]) << 8) | input[3];
+		const auto bits = (((static_cast<uint64_t>(sr) << 1) | lsb) << (byteCount * 8)) | (static_cast<uint64_t>(word) >> (32 - (byteCount * 8)));
+		sr = static_cast<uint32_t>(bits >> 1);
+		lsb = bits & 0x01;
+		srModulus <<= (byteCount * 8);
+		input += byteCount;
+		inputRemaining -= byteCount;
+	}
+
+	void IngestBytes() {
+		while (srModulus <= 0x800000) {
+			sr = (sr << 1) | lsb;
+			const auto b = inputRemaining ? *input : 0;
+			sr = (sr << 7) | (b >> 1);
+			lsb = b & 0x01;
+			srModulus <<= 8;
+			if (inputRemaining) {
+				input++;
+				inputRemaining--;
+			}
+		}
+	}
+
 	const uint8_t *input = nullptr;
+	size_t inputRemaining = 0;
 	uint32_t sr = 0;
 	uint32_t srModulus = 0;
 	uint8_t lsb = 0;
 };
 
-class Oodle1Decoder {
+// Decoding policies. The unchecked policy trusts the stream completely, and is only suitable for input
+// from a trusted compressor; the checked policy validates every header field, symbol index and repeat
+// offset that could otherwise lead to reads or writes out of bounds, and stops with an Oodle1Error instead.
+// The checked policy is only memory-safe with a length-bounded Oodle1Bitstream
+struct Oodle1Unchecked {
+	static constexpr bool CheckBounds = false;
+	static constexpr bool CollectStats = false;
+};
+
+struct Oodle1Checked {
+	static constexpr bool CheckBounds = true;
+	static constexpr bool CollectStats = false;
+};
+
+// Either policy, also counting what the decompressor does (see Oodle1Stats). Without it, none of the
+// counting code is compiled in
+template <typename Base> struct Oodle1WithStats : Base {
+	static constexpr bool CollectStats = true;
+};
+
+struct Oodle1DecoderStats {
+	uint64_t symbols = 0u;
+	uint64_t scanSteps = 0u;			// Steps of Decode's linear scan beyond the lookup's first candidate
+	uint64_t escapes = 0u;				// Symbols decoded as the escape, rather than as a normalized symbol
+	uint64_t probationaryHits = 0u;		// Escapes to a symbol learned since the last renormalization
+	uint64_t newSymbols = 0u;			// Escapes to a symbol never seen before
+	uint64_t renormalizations = 0u;
+	uint64_t decays = 0u;
+
+	double AverageScanDepth() const { return symbols ? (static_cast<double>(scanSteps) / symbols) : 0.0; }
+
+	Oodle1DecoderStats& operator+=(const Oodle1DecoderStats& rhs) {
+		symbols += rhs.symbols;
+		scanSteps += rhs.scanSteps;
+		escapes += rhs.escapes;
+		probationaryHits += rhs.probationaryHits;
+		newSymbols += rhs.newSymbols;
+		renormalizations += rhs.renormalizations;
+		decays += rhs.decays;
+		return *this;
+	}
+};
+
+// Counts for everything decompressed since the last Initialize; one decoder's counts for each decoder
+struct Oodle1Stats {
+	uint64_t literals = 0u;
+	uint64_t repeats = 0u;
+	uint64_t repeatBytes = 0u;
+	std::array<uint64_t,65> lengthCodes = { 0 };	// Code 0 counts literals
+	uint64_t bytes = 0u;
+	uint64_t cycles = 0u;							// Time-stamp counter cycles, or 0 without one
+	std::array<Oodle1DecoderStats,4> literalDecoders;
+	std::array<Oodle1DecoderStats,65> lengthDecoders;
+	Oodle1DecoderStats offset1Decoder;
+	std::array<Oodle1DecoderStats,256> offset4Decoders;
+	Oodle1DecoderStats offset1024Decoder;
+
+	double BytesPerCycle() const { return cycles ? (static_cast<double>(bytes) / cycles) : 0.0; }
+	// Every decoder's counts together
+	Oodle1DecoderStats Decoders() const;
+
+	Oodle1Stats& operator+=(const Oodle1Stats& rhs);
+};
+
+static constexpr auto Oodle1InvalidSymbol = UINT32_MAX;
+
+enum class Oodle1Error {
+	None = 0,
+	InvalidHeader,			// A header field lies outside the range supported by the decoders
+	SymbolOutOfRange,		// A decoder learned more symbols than its alphabet can hold
+	OffsetOutOfRange,		// A repeat reaches back before the start of the stream's output
+};
+
+template <uint32_t Capacity> class Oodle1Encoder;
+
+// Decoder state is held inline, sized for the largest alphabet the decoder will be initialized with. The
+// scalar state, and the arrays consulted on every Decode, come first; for small alphabets the whole
+// decoder fits within a cache line or two
+template <uint32_t Capacity> class Oodle1Decoder {
 public:
 	static constexpr auto One = 0x4000u;
+	static constexpr auto OneBits = 14u;
+	static constexpr auto MaxLookupBits = 8u;
 
 	Oodle1Decoder() = default;
 
 	void Initialize(uint32_t alphabetSize, uint32_t uniqueSymbols);
 	void Decay();
 	void Renormalize();
-	uint32_t Decode(Oodle1Bitstream& bs, uint32_t alphabetSize);
+	// Under a checked policy, returns Oodle1InvalidSymbol rather than learning a symbol beyond the alphabet.
+	// Under a policy which collects stats, they're added to stats. A nonzero AlphabetSize promises that alphabetSize
+	// is always that, so that learning a new symbol divides by a constant (a shift, for a power of two)
+	template <typename Policy = Oodle1Unchecked, uint32_t AlphabetSize = 0u> uint32_t Decode(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats = nullptr);
+	// Appends the model's adaptive state, which Restore reads back into a decoder initialized the same way. Restore
+	// advances data past what it read, and returns false rather than accepting a model that Decode can't safely use
+	void Save(std::vector<uint8_t>& state) const;
+	bool Restore(const uint8_t *&data, const uint8_t *end);
 
 private:
-	uint32_t usedSymbolCount = 0u;
-	std::vector<uint8_t> symbols;
-	std::vector<uint16_t> symbolWeights;		// SW
-	std::vector<uint16_t> symbolOccurrences;	// LSW
+	static constexpr uint32_t LookupBits(uint32_t alphabetSize) {
+		auto bits = 0u;
+		while ((bits < MaxLookupBits) && ((1u << bits) <= alphabetSize)) {
+			bits++;
+		}
+		return bits;
+	}
+
+	template <uint32_t AlphabetSize> static uint32_t GetSymbol(Oodle1Bitstream& bs, uint32_t alphabetSize) {
+		if constexpr (AlphabetSize && !(AlphabetSize & (AlphabetSize - 1))) {
+			return bs.Get<AlphabetSize>();
+		} else {
+			return bs.Get(AlphabetSize ? AlphabetSize : alphabetSize);
+		}
+	}
+
+	using Symbol = std::conditional_t<(Capacity <= 0x100u), uint8_t, uint16_t>;
+	using SymbolIndex = std::conditional_t<(Capacity < 0x100u), uint8_t, uint16_t>;
+
 	uint32_t totalOccurrence = 0u;				// TLW
+	uint32_t nextRenormWeight = 0u;				// NRW
 	uint32_t highestLearnedSymbol = 0u;			// HLS
 	uint32_t highestNormalizedSymbol = 0u;		// HLSN
-	uint32_t nextRenormWeight = 0u;				// NRW
+	uint32_t lookupShift = OneBits;
+	uint32_t usedSymbolCount = 0u;
 	uint32_t decayThreshold = 0u;				// DT
 	uint32_t rapidRenormInterval = 0u;			// RRI
 	uint32_t renormInterval = 0u;				// RI
+	uint32_t alphabetLimit = 0u;				// Number of array entries in use (alphabet size, plus 2)
+	std::array<SymbolIndex,(1u << LookupBits(Capacity))> symbolLookup;	// Lowest candidate symbol index, per bucket of z
+	std::array<uint16_t,Capacity + 2> symbolWeights;		// SW
+	std::array<uint16_t,Capacity + 2> symbolOccurrences;	// LSW
+	std::array<Symbol,Capacity + 2> symbols;
+
+	void BuildLookup();
+
+	// The encoder drives this same model, so that the two can never disagree about it
+	template <uint32_t> friend class Oodle1Encoder;
+};
+
+class Oodle1Decompressor;
+
+// One of the streams that Oodle1Decompressor::DecompressInterleaved advances together
+struct Oodle1Lane {
+	Oodle1Decompressor *decomp = nullptr;	// Reset on the lane's stream beforehand
+	uint8_t *output = nullptr;
+	size_t length = 0u;
+	bool outputSlack = false;
+	size_t decompressed = 0u;				// Set by DecompressInterleaved
 };
 
 class Oodle1Decompressor {
 public:
-	explicit Oodle1Decompressor(Oodle1Bitstream& bs) : bs(bs) { }
+	// The most input one token can read (four symbols, of at most three ingests each), plus the bitstream's
+	// word read-ahead, with some to spare
+	static constexpr auto MaxTokenInput = 64u;
+	static constexpr auto RepeatSlack = 32u;
+	static constexpr auto MaxWindowSize = 0x7fffffu;
+	static constexpr auto MaxLanes = 4u;
+
+	Oodle1Decompressor() = default;
+	explicit Oodle1Decompressor(Oodle1Bitstream& bs) : bs(&bs) { }
 
+	// Initializing re-initializes every decoder in place, so a single decompressor can be reused for any
+	// number of streams without reallocating
 	void Initialize(const uint32_t *header);
+	void Reset(Oodle1Bitstream& bs_, const uint32_t *header) {
+		bs = &bs_;
+		Initialize(header);
+	}
+	Oodle1Error GetError() const { return error; }
+	// Only counted by policies which collect stats
+	const Oodle1Stats& GetStats() const { return stats; }
+
+	// Decompresses a single literal or repeat, returning the number of bytes written
 	uint32_t Decompress(uint8_t *output);
+	// Decompresses exactly length bytes, even if that means stopping part-way through a repeat. Successive
+	// calls continue from where the previous call stopped, so output must follow on from the previous call's
+	// output, in the same buffer. If outputSlack is set, the caller guarantees that RepeatSlack bytes past
+	// output + length may be overwritten (their contents are indeterminate afterwards), which lets repeats be
+	// copied in whole blocks. Under a checked policy, decompression stops short of length (and every later
+	// call returns 0) once the stream is found to be ill-formed; GetError reports the reason
+	template <typename Policy = Oodle1Unchecked> size_t Decompress(uint8_t *output, size_t length, bool outputSlack = false);
+	// As above, but stops early, at a token boundary, before any token that starts with fewer than inputReserve
+	// bytes of the bitstream's input remaining. A reserve of MaxTokenInput ensures nothing past the input the
+	// bitstream was given is ever read, even though more may follow it
+	template <typename Policy = Oodle1Unchecked> size_t Decompress(uint8_t *output, size_t length, size_t inputReserve, bool outputSlack = false);
+	// Decompresses up to MaxLanes independent streams on the calling thread, a token from each in turn, so that
+	// an out-of-order core can overlap their otherwise serial decodes. Each lane ends up as though its
+	// decompressor's Decompress(output, length, outputSlack) had been called, and the lanes' decompressors and
+	// outputs must all be distinct. Worthwhile when there are more streams than cores to decode them on
+	template <typename Policy = Oodle1Unchecked> static void DecompressInterleaved(Oodle1Lane *lanes, size_t laneCount);
+	// Appends everything the LZ layer and its decoders need to carry on from between two calls to Decompress,
+	// apart from the bitstream's state and the output so far
+	void SaveState(std::vector<uint8_t>& state) const;
+	// Restores state appended by SaveState, onto a decompressor just initialized with the same header. The state
+	// must have been saved after position bytes of output, history of which precede the output of the next call.
+	// Returns false if the state is ill-formed, or couldn't be resumed from safely with the checked policy
+	bool RestoreState(const uint8_t *state, size_t size, uint64_t position, size_t history);
+	// The most output history that a repeat can refer back to under this header (see DecodeToken's offset)
+	static size_t MaxHistory(const uint32_t *header) { return static_cast<size_t>(header[0] >> 9) + 1024u; }
 
 private:
+	// The LZ state for one call's decode, which is worked on in locals, and only written back once it's done
+	struct Cursor {
+		Oodle1Decompressor *decomp;
+		Oodle1Lane *lane;
+		Oodle1Bitstream stream = Oodle1Bitstream(nullptr, 0u);
+		uint8_t *output;
+		size_t length;
+		size_t produced;
+		uint32_t outputCount;
+		uint32_t lastCode;
+		bool slack;			// Whether the lane's output may be overrun, as for Decompress's outputSlack
+	};
+
 	static constexpr uint32_t RepeatLengthTable[65] = {
 		 0,  2,  3,  4,  5,   6,  7,   8,
 		 9, 10, 11, 12, 13,  14,  15,  16,
@@ -134,18 +434,153 @@ private:
 		57, 58, 59, 60, 61, 128, 192, 256, 512
 	};
 
-	Oodle1Bitstream& bs;
-	std::array<Oodle1Decoder,4> litDecoders;
-	std::array<Oodle1Decoder,65> lenDecoders;
-	Oodle1Decoder off1Decoder;
-	std::array<Oodle1Decoder,256> off4Decoders;
-	Oodle1Decoder off1024Decoder;
+	// Each engine fixes some of the header's alphabet sizes at compile time (0 leaves them to the header), so that the
+	// decoders learn new symbols by dividing by constants. The byte engine suits nearly every stream: byte literals,
+	// and a window of at least three bytes
+	struct GenericEngine {
+		static constexpr auto LitAlphabetSize = 0u;
+		static constexpr auto Offset1AlphabetSize = 0u;
+	};
+
+	struct ByteEngine {
+		static constexpr auto LitAlphabetSize = 256u;
+		static constexpr auto Offset1AlphabetSize = 4u;
+	};
+
+	bool SuitsByteEngine() const {
+		return (litAlphabetSize == ByteEngine::LitAlphabetSize) && (offset1AlphabetSize == ByteEngine::Offset1AlphabetSize);
+	}
 
-	uint32_t windowSize = 0x7fffffu;
+	template <typename Policy, bool Slack, typename Engine> size_t DecompressBlock(uint8_t *output, size_t length, size_t inputReserve);
+	template <typename Policy, typename Engine, size_t Lanes> static void DecompressLanes(Cursor *cursors);
+	template <typename Policy, typename Engine> static void DecompressLaneSet(Cursor *cursors, size_t count);
+	// Returns false if nothing may be decoded at all; otherwise the cursor picks up from the previous call
+	template <typename Policy, bool Slack> bool BeginBlock(Cursor& cursor, uint8_t *output, size_t length);
+	// Decodes one token, returning false if it was ill-formed
+	template <typename Policy, bool Slack, typename Engine> bool DecodeToken(Oodle1Bitstream& stream, uint8_t *output, size_t length, size_t& produced,
+			uint32_t& outputCount, uint32_t& lastCode);
+	void EndBlock(const Cursor& cursor);
+
+	// Decoders only see their stats under policies which collect them, so nothing is passed otherwise
+	template <typename Policy> static Oodle1DecoderStats *DecoderStats(Oodle1DecoderStats& decoderStats) {
+		return Policy::CollectStats ? &decoderStats : nullptr;
+	}
+
+	Oodle1Decoder<65>& LenDecoder(uint32_t lastCode) {
+		if (!lenReady[lastCode]) {
+			// Decoders are grouped 16 to a unique-symbol count; the group holding only the last decoder
+			// takes what remains once all four counts have been shifted out of the header, i.e. 0
+			lenDecoders[lastCode].Initialize(65, lenUniqueSymbols[lastCode / 16]);
+			lenReady[lastCode] = true;
+		}
+		return lenDecoders[lastCode];
+	}
+
+	Oodle1Decoder<256>& Off4Decoder(uint32_t off1k) {
+		if (!off4Ready[off1k]) {
+			off4Decoders[off1k].Initialize(offset4AlphabetSize, offset4AlphabetSize);
+			off4Ready[off1k] = true;
+		}
+		return off4Decoders[off1k];
+	}
+
+	Oodle1Bitstream *bs = nullptr;
+	std::array<Oodle1Decoder<256>,4> litDecoders;
+	std::array<Oodle1Decoder<65>,65> lenDecoders;
+	Oodle1Decoder<4> off1Decoder;
+	std::array<Oodle1Decoder<256>,256> off4Decoders;
+	Oodle1Decoder<(MaxWindowSize / 1024) + 1> off1024Decoder;
+
+	uint32_t windowSize = MaxWindowSize;
 	uint32_t litAlphabetSize = 256u;
 	uint32_t offset1AlphabetSize = 0u;
+	uint32_t offset4AlphabetSize = 0u;
+	std::array<uint32_t,5> lenUniqueSymbols = { 0 };
+	std::bitset<65> lenReady;
+	std::bitset<256> off4Ready;
 	uint32_t bytesOutput = 0u;
 	uint32_t lastRepeatCode = 0u;
+	uint32_t pendingOffset = 0u;	// Offset / remaining length of a repeat left unfinished by Decompress(output, length)
+	uint32_t pendingLength = 0u;
+	Oodle1Error headerError = Oodle1Error::None;	// Reported by the first checked Decompress after Initialize
+	Oodle1Error error = Oodle1Error::None;
+	Oodle1Stats stats;
+	bool statsCollected = false;	// Since the last Initialize; if not, the stats needn't be cleared
+};
+
+// Decompresses a single stream from input that arrives piecemeal (e.g. from a network). Only the unconsumed
+// input and a sliding window of recent output are held, so memory use is bounded by the header's window size
+// rather than by the size of the stream. Input is always treated as untrusted.
+class Oodle1StreamDecompressor {
+public:
+	explicit Oodle1StreamDecompressor(const uint32_t *header);
+	Oodle1StreamDecompressor(const Oodle1StreamDecompressor&) = delete;
+	Oodle1StreamDecompressor& operator=(const Oodle1StreamDecompressor&) = delete;
+
+	// Appends more of the stream's input. Once final is set, everything remaining may be decoded, with the
+	// input behaving as though it were followed by zero padding
+	void Feed(const uint8_t *input_, size_t length, bool final = false);
+	// Decompresses up to maxLength more bytes, as far as the input so far allows, pointing output at them. They
+	// remain valid until the next call. Returns 0 once more input is needed, or the stream is found to be
+	// ill-formed (see GetError). Streams don't record their own length, so the caller must stop at the end
+	size_t Decompress(const uint8_t *&output, size_t maxLength = SIZE_MAX);
+	Oodle1Error GetError() const { return decomp->GetError(); }
+
+private:
+	static constexpr auto MinWindowChunk = 0x10000u;
+
+	std::unique_ptr<Oodle1Decompressor> decomp;
+	std::array<uint32_t,3> header;
+	std::vector<uint8_t> input;
+	bool inputFinal = false;
+	Oodle1Bitstream bs;
+	Oodle1Bitstream::State bsState;
+	bool started = false;
+	std::vector<uint8_t> window;
+	size_t windowHistory = 0u;
+	size_t windowEnd = 0u;
+};
+
+// Random access into a single stream, which otherwise can only be decoded from its start. Building the index
+// decodes the whole stream once, snapshotting the decompressor every so often; a read then decodes only from the
+// nearest snapshot at or before it. Each checkpoint holds the decoder models in use and up to MaxHistory bytes of
+// output, so checkpoints should be several windows apart. Input to Read is treated as untrusted, as is any index
+// passed to Load
+class Oodle1CheckpointIndex {
+public:
+	static constexpr auto DefaultInterval = 0x100000u;
+
+	Oodle1CheckpointIndex() = default;
+
+	// Decompresses all length bytes of the stream, as a checked Decompress(output, length, outputSlack) would,
+	// checkpointing every interval bytes of output. Returns false if the stream is ill-formed
+	bool Build(const uint32_t *header, const uint8_t *input, size_t inputLength, uint8_t *output, size_t length,
+			size_t interval = DefaultInterval, bool outputSlack = false);
+	// Decompresses the length bytes of output starting at offset, from the same input as the index was built from,
+	// returning the number of bytes read (fewer if the range runs past the end, or the input is ill-formed)
+	size_t Read(const uint8_t *input, size_t inputLength, uint64_t offset, uint8_t *output, size_t length);
+	size_t GetCheckpointCount() const { return checkpoints.size(); }
+	uint64_t GetLength() const { return length; }
+
+	// Serializes the index (little-endian, whatever the host), and reads it back
+	void Save(std::vector<uint8_t>& data) const;
+	bool Load(const uint8_t *data, size_t size);
+
+private:
+	static constexpr uint32_t Signature = 0x58493130u;	// "01IX"
+
+	struct Checkpoint {
+		uint64_t position = 0u;
+		Oodle1Bitstream::State stream;
+		std::vector<uint8_t> history;		// The output immediately before position
+		std::vector<uint8_t> state;			// From Oodle1Decompressor::SaveState
+	};
+
+	std::array<uint32_t,3> header = { 0 };
+	uint64_t length = 0u;
+	std::vector<Checkpoint> checkpoints;	// In order of position, the first at 0
+	std::unique_ptr<Oodle1Decompressor> decomp;
+	std::vector<uint8_t> window;
 };
 
 }
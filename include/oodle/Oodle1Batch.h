@@ -0,0 +1,76 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#ifndef LIBOODLE_OODLE1BATCH_H
+#define LIBOODLE_OODLE1BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <oodle/Oodle1.h>
+
+namespace Oodle {
+
+// One independent stream of a batch, and what became of it
+struct Oodle1BatchJob {
+	const uint32_t *header = nullptr;	// The stream's three header words
+	const uint8_t *input = nullptr;		// Read as though followed by zero padding, so needn't be padded itself
+	size_t inputLength = 0u;
+	uint8_t *output = nullptr;
+	size_t outputLength = 0u;			// Streams don't record their own length, so exactly this much is decoded
+	bool outputSlack = false;			// As for Oodle1Decompressor::Decompress
+
+	size_t decompressed = 0u;			// Set by the batch; short of outputLength if the stream is ill-formed
+	Oodle1Error error = Oodle1Error::None;
+};
+
+// Decompresses many small, independent streams across a number of threads. Each thread keeps one decompressor
+// per lane, which is re-initialized in place for every job it takes, and which survives from batch to batch, so
+// a job costs only its header's initialization and its decode. With more than one lane, each thread decodes
+// that many jobs at once, interleaved (see Oodle1Decompressor::DecompressInterleaved)
+class Oodle1BatchDecompressor {
+public:
+	// Threads claim this many jobs at a time, so that tiny jobs don't contend over the queue
+	static constexpr auto JobsPerClaim = 16u;
+
+	// Lanes are clamped to [1, Oodle1Decompressor::MaxLanes]
+	explicit Oodle1BatchDecompressor(unsigned threads = 1u, unsigned lanes = 1u);
+
+	// Returns true if every job decompressed all of its output. The jobs' outputs mustn't overlap. Input is
+	// treated as untrusted, unless the Oodle1Unchecked policy is given
+	template <typename Policy = Oodle1Checked> bool Decompress(Oodle1BatchJob *jobs, size_t jobCount);
+	template <typename Policy = Oodle1Checked> bool Decompress(std::vector<Oodle1BatchJob>& jobs) {
+		return Decompress<Policy>(jobs.data(), jobs.size());
+	}
+
+private:
+	size_t threadCount;
+	size_t laneCount;
+	std::vector<std::unique_ptr<Oodle1Decompressor>> decomps;	// laneCount per thread, allocated on first use
+};
+
+}
+
+#endif
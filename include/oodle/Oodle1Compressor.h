@@ -0,0 +1,170 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#ifndef LIBOODLE_OODLE1COMPRESSOR_H
+#define LIBOODLE_OODLE1COMPRESSOR_H
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <oodle/Oodle1.h>
+
+namespace Oodle {
+
+// The inverse of Oodle1Bitstream. The encoded number is held as a vector of digits (a 7-bit digit, then 8-bit
+// digits, as the bitstream ingests them), so that carries can always be propagated back into digits which
+// have already been produced. The range always equals the bitstream's srModulus at the same point
+class Oodle1BitstreamWriter {
+public:
+	Oodle1BitstreamWriter() { Reset(); }
+
+	void Reset() {
+		digits.assign(1u, 0u);
+		range = 0x80;
+	}
+
+	// Mirrors Peek followed by Consume
+	void Put(uint32_t minZ, uint32_t spanZ, uint32_t one) {
+		Normalize();
+		const auto scale = (range / one);
+		Add(minZ * scale);
+		if (minZ < (one - spanZ)) {
+			range = spanZ * scale;
+		} else {
+			range -= minZ * scale;
+		}
+	}
+
+	// Mirrors Get
+	void Put(uint32_t z, uint32_t one) {
+		Normalize();
+		const auto scale = (range / one);
+		Add(z * scale);
+		if (z < (one - 1)) {
+			range = scale;
+		} else {
+			range -= z * scale;
+		}
+	}
+
+	// Packs the digits into bytes; the decoder behaves as though the final, partial byte were zero-padded
+	std::vector<uint8_t> Finish() const;
+
+private:
+	std::vector<uint8_t> digits;
+	uint32_t range = 0u;
+
+	void Normalize() {
+		while (range <= 0x800000) {
+			digits.push_back(0u);
+			range <<= 8;
+		}
+	}
+
+	void Add(uint32_t value) {
+		// The encoded number never exceeds its initial range, so the carry is always absorbed
+		auto idx = digits.size();
+		while (value) {
+			idx--;
+			value += digits[idx];
+			digits[idx] = value & 0xFF;
+			value >>= 8;
+		}
+	}
+};
+
+// Encodes symbols as the matching Oodle1Decoder will decode them, by driving an Oodle1Decoder's model in
+// exactly the same way, and only adding what the encoder needs to find a symbol within it
+template <uint32_t Capacity> class Oodle1Encoder {
+public:
+	Oodle1Encoder() = default;
+
+	void Initialize(uint32_t alphabetSize, uint32_t uniqueSymbols);
+	// Returns false if the model can't represent the symbol, which is only possible if the stream's header
+	// understates its alphabet or unique-symbol counts
+	bool Encode(Oodle1BitstreamWriter& bs, uint32_t symbol, uint32_t alphabetSize);
+
+private:
+	using SymbolIndex = std::conditional_t<(Capacity < 0x100u), uint8_t, uint16_t>;
+
+	Oodle1Decoder<Capacity> model;
+	std::array<SymbolIndex,Capacity> symbolIndices;		// Index of each symbol within the model, or 0
+
+	void IndexSymbols(SymbolIndex value);
+};
+
+enum class Oodle1Level {
+	Fast = 0,		// Greedy parse over a shallow hash chain
+	Normal,			// Lazy parse, looking one byte ahead
+	Optimal,		// Minimum-cost parse, priced with statistics gathered from a lazy parse
+};
+
+// Compresses a sequence of streams into one shared bitstream, in the same way a Granny section holds its three
+// streams; each stream has its own header and decoders, but picks up the bitstream where the last one left off
+class Oodle1Compressor {
+public:
+	static constexpr auto HeaderWords = 3u;
+	static constexpr auto MaxWindowSize = 0x40000u;		// The format's 256KiB cap, rather than the decoder's
+	static constexpr auto MinMatchLength = 3u;
+
+	// A literal or repeat, as chosen by the parser
+	struct Token {
+		uint32_t length = 0u;
+		uint32_t offset = 0u;	// 0 for a literal
+	};
+
+	explicit Oodle1Compressor(Oodle1Level level_ = Oodle1Level::Normal) : level(level_) { }
+
+	// Parses one stream, without touching any compressor, so that streams may be parsed on other threads
+	static void Parse(const uint8_t *input, uint32_t length, Oodle1Level level, std::vector<Token>& tokens);
+
+	// Compresses one stream onto the end of the bitstream, and writes its HeaderWords-word header. Failure
+	// leaves the bitstream unusable, until Finish resets it
+	bool Compress(const uint8_t *input, size_t length, uint32_t *header);
+	// Compresses a stream which has already been parsed at any level; the input must be the one parsed
+	bool Compress(const uint8_t *input, const std::vector<Token>& tokens, uint32_t *header);
+	// Returns the finished bitstream, and resets the compressor for another
+	std::vector<uint8_t> Finish();
+
+private:
+	Oodle1Level level;
+	Oodle1BitstreamWriter bs;
+	std::vector<Token> tokens;
+
+	std::array<Oodle1Encoder<256>,4> litEncoders;
+	std::array<Oodle1Encoder<65>,65> lenEncoders;
+	Oodle1Encoder<4> off1Encoder;
+	std::array<Oodle1Encoder<256>,256> off4Encoders;
+	Oodle1Encoder<(Oodle1Decompressor::MaxWindowSize / 1024) + 1> off1024Encoder;
+	std::bitset<65> lenReady;
+	std::bitset<256> off4Ready;
+
+	bool Emit(const uint8_t *input, const std::vector<Token>& tokens, uint32_t *header);
+};
+
+}
+
+#endif
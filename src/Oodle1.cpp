@@ -22,32 +22,141 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 //
 // For more information, please refer to <https://unlicense.org>
+#include <cstring>
 #include <iostream>
 #include <oodle/Oodle1.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace Oodle {
 
-void Oodle1Decoder::Initialize(uint32_t alphabetSize, uint32_t uniqueSymbols) {
+static uint64_t ReadCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0u;
+#endif
+}
+
+// Checkpoint state is serialized little-endian, whatever the host
+template <typename T> static void AppendLE(std::vector<uint8_t>& data, T value) {
+	for (auto byteIdx = 0u; byteIdx < sizeof(T); byteIdx++) {
+		data.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (byteIdx * 8)));
+	}
+}
+
+template <typename T> static bool ReadLE(const uint8_t *&data, const uint8_t *end, T& value) {
+	if (static_cast<size_t>(end - data) < sizeof(T)) {
+		return false;
+	}
+	uint64_t bits = 0u;
+	for (auto byteIdx = 0u; byteIdx < sizeof(T); byteIdx++) {
+		bits |= static_cast<uint64_t>(data[byteIdx]) << (byteIdx * 8);
+	}
+	value = static_cast<T>(bits);
+	data += sizeof(T);
+	return true;
+}
+
+template <uint32_t Capacity> void Oodle1Decoder<Capacity>::Initialize(uint32_t alphabetSize, uint32_t uniqueSymbols) {
 	usedSymbolCount = uniqueSymbols;
-	symbols.resize(alphabetSize + 2);
-	symbolWeights.resize(alphabetSize + 2);
-	symbolOccurrences.resize(alphabetSize + 2);
-	std::fill(symbolWeights.begin(), symbolWeights.end(), One);
+	alphabetLimit = std::min(alphabetSize, Capacity) + 2;
+	std::fill(symbolWeights.begin(), symbolWeights.begin() + alphabetLimit, One);
+	std::fill(symbolOccurrences.begin(), symbolOccurrences.begin() + alphabetLimit, 0);
 	symbolWeights[0] = 0;
 	symbolOccurrences[0] = 4;
 	totalOccurrence = symbolOccurrences[0];
+	highestLearnedSymbol = 0;
+	highestNormalizedSymbol = 0;
 	nextRenormWeight = 8;
 	decayThreshold = std::max(256u, std::min((alphabetSize - 1) * 32, 15160u));
 	rapidRenormInterval = 4;
 	renormInterval = std::max(128u, std::min((alphabetSize - 1) * 2, (decayThreshold / 2) - 32));
+	const auto lookupBits = LookupBits(alphabetLimit - 2);
+	lookupShift = OneBits - lookupBits;
+	std::fill(symbolLookup.begin(), symbolLookup.begin() + (1u << lookupBits), 0);
+}
+
+// Each bucket records the highest symbol whose span begins at or before the bucket's lowest z, so
+// that Decode only has to scan forward through the (few) symbols which begin within the bucket
+template <uint32_t Capacity> void Oodle1Decoder<Capacity>::BuildLookup() {
+	auto symbolIdx = 0u;
+	const auto bucketCount = 1u << (OneBits - lookupShift);
+	for (auto bucket = 0u; bucket < bucketCount; bucket++) {
+		const auto z = bucket << lookupShift;
+		while (symbolWeights[symbolIdx + 1] <= z) {
+			symbolIdx++;
+		}
+		symbolLookup[bucket] = symbolIdx;
+	}
+}
+
+// The index of the first of counts[1..last] to hold their largest value, or 0 if last is 0. Counts must be below
+// 0x8000, so that they compare the same as signed 16-bit lanes
+static uint32_t FindHighest(const uint16_t *counts, uint32_t last) {
+	auto highest = 0u;
+	auto idx = 1u;
+#if defined(__SSE2__)
+	auto maxima = _mm_setzero_si128();
+	for (; (idx + 8u) <= (last + 1u); idx += 8u) {
+		maxima = _mm_max_epi16(maxima, _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + idx)));
+	}
+	maxima = _mm_max_epi16(maxima, _mm_srli_si128(maxima, 8));
+	maxima = _mm_max_epi16(maxima, _mm_srli_si128(maxima, 4));
+	maxima = _mm_max_epi16(maxima, _mm_srli_si128(maxima, 2));
+	highest = static_cast<uint32_t>(_mm_cvtsi128_si32(maxima)) & 0xffffu;
+#endif
+	for (; idx <= last; idx++) {
+		highest = std::max(highest, static_cast<uint32_t>(counts[idx]));
+	}
+	if (!last) {
+		return 0u;
+	}
+	idx = 1u;
+#if defined(__SSE2__)
+	const auto target = _mm_set1_epi16(static_cast<int16_t>(highest));
+	for (; (idx + 8u) <= (last + 1u); idx += 8u) {
+		const auto matches = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + idx)), target));
+		if (matches) {
+			return idx + (__builtin_ctz(matches) / 2u);
+		}
+	}
+#endif
+	while (counts[idx] != highest) {
+		idx++;
+	}
+	return idx;
 }
 
-void Oodle1Decoder::Decay() {
+// Weights are left as they were. Decay is always followed by a Renormalize, which replaces them
+template <uint32_t Capacity> void Oodle1Decoder<Capacity>::Decay() {
 	symbolOccurrences[0] /= 2;
 	totalOccurrence = symbolOccurrences[0];
-	auto highestWeight = 0u;
-	auto highestIndex = 0u;
-	for (auto idx = 1u; idx <= highestLearnedSymbol; idx++) {
+	auto idx = 1u;
+#if defined(__SSE2__)
+	// Runs of symbols of which none would be dropped are halved a vector at a time; only a count of 0 or 1 is left
+	// unchanged by a saturating decrement
+	const auto ones = _mm_set1_epi16(1);
+	auto sums = _mm_setzero_si128();
+#endif
+	while (idx <= highestLearnedSymbol) {
+#if defined(__SSE2__)
+		if ((idx + 8u) <= (highestLearnedSymbol + 1u)) {
+			const auto address = reinterpret_cast<__m128i*>(&symbolOccurrences[idx]);
+			const auto occurrences = _mm_loadu_si128(address);
+			if (!_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(occurrences, ones), _mm_setzero_si128()))) {
+				const auto halved = _mm_srli_epi16(occurrences, 1);
+				_mm_storeu_si128(address, halved);
+				sums = _mm_add_epi32(sums, _mm_madd_epi16(halved, ones));
+				idx += 8u;
+				continue;
+			}
+		}
+#endif
 		while (symbolOccurrences[idx] <= 1) {
 			if (idx >= highestLearnedSymbol) {
 				symbolOccurrences[idx] = 0;
@@ -65,12 +174,16 @@ void Oodle1Decoder::Decay() {
 		}
 		symbolOccurrences[idx] /= 2;
 		totalOccurrence += symbolOccurrences[idx];
-		if (symbolOccurrences[idx] > highestWeight) {
-			highestWeight = symbolOccurrences[idx];
-			highestIndex = idx;
-		}
+		idx++;
 	}
-	if (highestWeight && (highestIndex != highestLearnedSymbol)) {
+#if defined(__SSE2__)
+	sums = _mm_add_epi32(sums, _mm_srli_si128(sums, 8));
+	sums = _mm_add_epi32(sums, _mm_srli_si128(sums, 4));
+	totalOccurrence += static_cast<uint32_t>(_mm_cvtsi128_si32(sums));
+#endif
+	// Every count left has been halved, so is below 0x8000, and no symbol has moved since
+	const auto highestIndex = FindHighest(symbolOccurrences.data(), highestLearnedSymbol);
+	if (highestIndex && (highestIndex != highestLearnedSymbol)) {
 		std::swap(symbolOccurrences[highestLearnedSymbol], symbolOccurrences[highestIndex]);
 		std::swap(symbols[highestLearnedSymbol], symbols[highestIndex]);
 	}
@@ -78,14 +191,35 @@ void Oodle1Decoder::Decay() {
 		symbolOccurrences[0] = 1;
 		totalOccurrence++;
 	}
-	std::fill(symbolWeights.begin() + highestLearnedSymbol + 1, symbolWeights.end(), One);
 }
 
-void Oodle1Decoder::Renormalize() {
+template <uint32_t Capacity> void Oodle1Decoder<Capacity>::Renormalize() {
 	const auto quanta = 0x20000 / totalOccurrence;
 	symbolWeights[0] = 0;
 	auto accumulator = (symbolOccurrences[0] * quanta) / 8;
-	for (auto idx = 1u; idx <= highestLearnedSymbol; idx++) {
+	auto idx = 1u;
+#if defined(__SSE2__)
+	// Weights are prefix sums of spans which together come to at most One, so 16-bit lanes hold them. A count times
+	// the quanta can need 18 bits, though, so it's formed from the 16-bit halves of the quanta, then shifted down
+	const auto quantaLow = _mm_set1_epi16(static_cast<int16_t>(quanta & 0xffffu));
+	const auto quantaHigh = _mm_set1_epi16(static_cast<int16_t>(quanta >> 16));
+	auto base = _mm_set1_epi16(static_cast<int16_t>(accumulator));
+	for (; (idx + 8u) <= (highestLearnedSymbol + 1u); idx += 8u) {
+		const auto occurrences = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&symbolOccurrences[idx]));
+		const auto productLow = _mm_mullo_epi16(occurrences, quantaLow);
+		const auto productHigh = _mm_add_epi16(_mm_mulhi_epu16(occurrences, quantaLow), _mm_mullo_epi16(occurrences, quantaHigh));
+		auto spans = _mm_or_si128(_mm_srli_epi16(productLow, 3), _mm_slli_epi16(productHigh, 13));
+		spans = _mm_add_epi16(spans, _mm_slli_si128(spans, 2));
+		spans = _mm_add_epi16(spans, _mm_slli_si128(spans, 4));
+		spans = _mm_add_epi16(spans, _mm_slli_si128(spans, 8));
+		// Each weight is the sum of the spans before its own
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&symbolWeights[idx]), _mm_add_epi16(base, _mm_slli_si128(spans, 2)));
+		const auto last = _mm_shufflehi_epi16(spans, 0xff);
+		base = _mm_add_epi16(base, _mm_unpackhi_epi64(last, last));
+	}
+	accumulator = static_cast<uint32_t>(_mm_cvtsi128_si32(base)) & 0xffffu;
+#endif
+	for (; idx <= highestLearnedSymbol; idx++) {
 		symbolWeights[idx] = accumulator;
 		accumulator += ((symbolOccurrences[idx] * quanta) / 8);
 	}
@@ -95,41 +229,69 @@ void Oodle1Decoder::Renormalize() {
 	} else {
 		nextRenormWeight = totalOccurrence + renormInterval;
 	}
+	// Weights beyond the last normalized symbol are always One, so only those a Decay has just dropped need resetting
+	if (highestNormalizedSymbol > highestLearnedSymbol) {
+		std::fill(symbolWeights.begin() + highestLearnedSymbol + 1, symbolWeights.begin() + highestNormalizedSymbol + 1, One);
+	}
 	highestNormalizedSymbol = highestLearnedSymbol;
-	std::fill(symbolWeights.begin() + highestLearnedSymbol + 1, symbolWeights.end(), One);
+	BuildLookup();
 }
 
-uint32_t Oodle1Decoder::Decode(Oodle1Bitstream& bs, uint32_t alphabetSize) {
+template <uint32_t Capacity> template <typename Policy, uint32_t AlphabetSize> uint32_t Oodle1Decoder<Capacity>::Decode(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats) {
+	if (Policy::CollectStats) {
+		stats->symbols++;
+	}
 	if (totalOccurrence >= nextRenormWeight) {
 		if (totalOccurrence >= decayThreshold) {
 			Decay();
+			if (Policy::CollectStats) {
+				stats->decays++;
+			}
 		}
 		Renormalize();
+		if (Policy::CollectStats) {
+			stats->renormalizations++;
+		}
 	}
-	const auto z = bs.Peek(One);
-	auto symbolIdx = 0u;
-	for (symbolIdx = 0u; symbolIdx <= highestNormalizedSymbol; symbolIdx++) {
-		if (symbolWeights[symbolIdx + 1] > z) {
-			break;
+	const auto z = bs.Peek<One>();
+	// Weights are non-decreasing and symbolWeights[highestNormalizedSymbol + 1] is One, so the scan
+	// always terminates within the active alphabet
+	auto symbolIdx = static_cast<uint32_t>(symbolLookup[z >> lookupShift]);
+	while (symbolWeights[symbolIdx + 1] <= z) {
+		symbolIdx++;
+		if (Policy::CollectStats) {
+			stats->scanSteps++;
 		}
 	}
-	bs.Consume(symbolWeights[symbolIdx], symbolWeights[symbolIdx + 1] - symbolWeights[symbolIdx], One);
+	bs.Consume<One>(symbolWeights[symbolIdx], symbolWeights[symbolIdx + 1] - symbolWeights[symbolIdx]);
 	symbolOccurrences[symbolIdx]++;
 	totalOccurrence++;
 	if (symbolIdx) {
 		return symbols[symbolIdx];
 	} else {
+		if (Policy::CollectStats) {
+			stats->escapes++;
+		}
 		if (highestLearnedSymbol != highestNormalizedSymbol) {
-			const auto b = bs.Get(2);
+			const auto b = bs.Get<2>();
 			if (b) {
+				if (Policy::CollectStats) {
+					stats->probationaryHits++;
+				}
 				symbolIdx = bs.Get(highestLearnedSymbol - highestNormalizedSymbol) + highestNormalizedSymbol + 1;
 				symbolOccurrences[symbolIdx] += 2;
 				totalOccurrence += 2;
 				return symbols[symbolIdx];
 			}
 		}
+		if (Policy::CheckBounds && ((highestLearnedSymbol + 3) > alphabetLimit)) {
+			return Oodle1InvalidSymbol;
+		}
+		if (Policy::CollectStats) {
+			stats->newSymbols++;
+		}
 		highestLearnedSymbol++;
-		const auto symbol = bs.Get(alphabetSize);
+		const auto symbol = GetSymbol<AlphabetSize>(bs, alphabetSize);
 		symbols[highestLearnedSymbol] = symbol;
 		symbolOccurrences[highestLearnedSymbol] += 2;
 		totalOccurrence += 2;
@@ -141,36 +303,244 @@ uint32_t Oodle1Decoder::Decode(Oodle1Bitstream& bs, uint32_t alphabetSize) {
 	}
 }
 
+// Past the highest learned symbol, occurrences are always 0, and past the highest normalized symbol, weights are
+// always One, so neither is saved
+template <uint32_t Capacity> void Oodle1Decoder<Capacity>::Save(std::vector<uint8_t>& state) const {
+	AppendLE(state, totalOccurrence);
+	AppendLE(state, nextRenormWeight);
+	AppendLE(state, static_cast<uint16_t>(highestLearnedSymbol));
+	AppendLE(state, static_cast<uint16_t>(highestNormalizedSymbol));
+	AppendLE(state, rapidRenormInterval);
+	for (auto idx = 1u; idx <= highestNormalizedSymbol; idx++) {
+		AppendLE(state, symbolWeights[idx]);
+	}
+	AppendLE(state, symbolOccurrences[0]);
+	for (auto idx = 1u; idx <= highestLearnedSymbol; idx++) {
+		AppendLE(state, symbolOccurrences[idx]);
+		AppendLE(state, static_cast<uint16_t>(symbols[idx]));
+	}
+}
+
+// Everything Initialize derives from the alphabet is left as it is, and the lookup is rebuilt from the weights, so
+// only the invariants Decode relies on to stay within the arrays have to be checked: that the scan always comes to a
+// weight of One within the active alphabet, that learning stays within it, and that nothing divides by zero
+template <uint32_t Capacity> bool Oodle1Decoder<Capacity>::Restore(const uint8_t *&data, const uint8_t *end) {
+	uint32_t total, renormWeight, rapidInterval;
+	uint16_t learned, normalized;
+	if (!ReadLE(data, end, total) || !ReadLE(data, end, renormWeight) || !ReadLE(data, end, learned) ||
+			!ReadLE(data, end, normalized) || !ReadLE(data, end, rapidInterval) || ((learned + 2u) > alphabetLimit) ||
+			(normalized > learned) || (static_cast<size_t>(end - data) < ((normalized * 2u) + 2u + (learned * 4u)))) {
+		return false;
+	}
+	symbolWeights[0] = 0;
+	for (auto idx = 1u; idx <= normalized; idx++) {
+		ReadLE(data, end, symbolWeights[idx]);
+		if (symbolWeights[idx] < symbolWeights[idx - 1]) {
+			return false;
+		}
+	}
+	if (symbolWeights[normalized] > One) {
+		return false;
+	}
+	std::fill(symbolWeights.begin() + normalized + 1, symbolWeights.begin() + alphabetLimit, One);
+	ReadLE(data, end, symbolOccurrences[0]);
+	auto occurrenceSum = static_cast<uint32_t>(symbolOccurrences[0]);
+	for (auto idx = 1u; idx <= learned; idx++) {
+		uint16_t symbol = 0u;
+		ReadLE(data, end, symbolOccurrences[idx]);
+		ReadLE(data, end, symbol);
+		if (symbol >= (alphabetLimit - 2)) {
+			return false;
+		}
+		occurrenceSum += symbolOccurrences[idx];
+		symbols[idx] = static_cast<Symbol>(symbol);
+	}
+	std::fill(symbolOccurrences.begin() + learned + 1, symbolOccurrences.begin() + alphabetLimit, 0);
+	if (!total || (occurrenceSum != total)) {
+		return false;
+	}
+	totalOccurrence = total;
+	nextRenormWeight = renormWeight;
+	highestLearnedSymbol = learned;
+	highestNormalizedSymbol = normalized;
+	rapidRenormInterval = rapidInterval;
+	BuildLookup();
+	return true;
+}
+
+template class Oodle1Decoder<4>;
+template class Oodle1Decoder<65>;
+template class Oodle1Decoder<256>;
+template class Oodle1Decoder<(Oodle1Decompressor::MaxWindowSize / 1024) + 1>;
+template uint32_t Oodle1Decoder<4>::Decode<Oodle1Unchecked>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<4>::Decode<Oodle1Checked>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<4>::Decode<Oodle1WithStats<Oodle1Unchecked>>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<4>::Decode<Oodle1WithStats<Oodle1Checked>>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<65>::Decode<Oodle1Unchecked>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<65>::Decode<Oodle1Checked>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<65>::Decode<Oodle1WithStats<Oodle1Unchecked>>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<65>::Decode<Oodle1WithStats<Oodle1Checked>>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<256>::Decode<Oodle1Unchecked>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<256>::Decode<Oodle1Checked>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<256>::Decode<Oodle1WithStats<Oodle1Unchecked>>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<256>::Decode<Oodle1WithStats<Oodle1Checked>>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<(Oodle1Decompressor::MaxWindowSize / 1024) + 1>::Decode<Oodle1Unchecked>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<(Oodle1Decompressor::MaxWindowSize / 1024) + 1>::Decode<Oodle1Checked>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<(Oodle1Decompressor::MaxWindowSize / 1024) + 1>::Decode<Oodle1WithStats<Oodle1Unchecked>>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<(Oodle1Decompressor::MaxWindowSize / 1024) + 1>::Decode<Oodle1WithStats<Oodle1Checked>>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<4>::Decode<Oodle1Unchecked,4u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<4>::Decode<Oodle1Checked,4u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<4>::Decode<Oodle1WithStats<Oodle1Unchecked>,4u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<4>::Decode<Oodle1WithStats<Oodle1Checked>,4u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<65>::Decode<Oodle1Unchecked,65u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<65>::Decode<Oodle1Checked,65u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<65>::Decode<Oodle1WithStats<Oodle1Unchecked>,65u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<65>::Decode<Oodle1WithStats<Oodle1Checked>,65u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<256>::Decode<Oodle1Unchecked,256u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<256>::Decode<Oodle1Checked,256u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<256>::Decode<Oodle1WithStats<Oodle1Unchecked>,256u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+template uint32_t Oodle1Decoder<256>::Decode<Oodle1WithStats<Oodle1Checked>,256u>(Oodle1Bitstream& bs, uint32_t alphabetSize, Oodle1DecoderStats *stats);
+
+Oodle1DecoderStats Oodle1Stats::Decoders() const {
+	Oodle1DecoderStats total = offset1Decoder;
+	total += offset1024Decoder;
+	for (const auto& decoder : literalDecoders) {
+		total += decoder;
+	}
+	for (const auto& decoder : lengthDecoders) {
+		total += decoder;
+	}
+	for (const auto& decoder : offset4Decoders) {
+		total += decoder;
+	}
+	return total;
+}
+
+Oodle1Stats& Oodle1Stats::operator+=(const Oodle1Stats& rhs) {
+	literals += rhs.literals;
+	repeats += rhs.repeats;
+	repeatBytes += rhs.repeatBytes;
+	for (auto idx = 0u; idx < lengthCodes.size(); idx++) {
+		lengthCodes[idx] += rhs.lengthCodes[idx];
+	}
+	bytes += rhs.bytes;
+	cycles += rhs.cycles;
+	for (auto idx = 0u; idx < literalDecoders.size(); idx++) {
+		literalDecoders[idx] += rhs.literalDecoders[idx];
+	}
+	for (auto idx = 0u; idx < lengthDecoders.size(); idx++) {
+		lengthDecoders[idx] += rhs.lengthDecoders[idx];
+	}
+	offset1Decoder += rhs.offset1Decoder;
+	for (auto idx = 0u; idx < offset4Decoders.size(); idx++) {
+		offset4Decoders[idx] += rhs.offset4Decoders[idx];
+	}
+	offset1024Decoder += rhs.offset1024Decoder;
+	return *this;
+}
+
 void Oodle1Decompressor::Initialize(const uint32_t *header) {
+	if (statsCollected) {
+		stats = Oodle1Stats();
+		statsCollected = false;
+	}
+	bytesOutput = 0;
+	lastRepeatCode = 0;
+	pendingOffset = 0;
+	pendingLength = 0;
+	error = Oodle1Error::None;
 	windowSize = header[0] >> 9;
 	// Initialize literal decoders
 	litAlphabetSize = header[0] & 0x1FF;
+	// Literals are bytes, and every decoder needs a non-empty alphabet
+	headerError = ((litAlphabetSize < 1) || (litAlphabetSize > 256)) ? Oodle1Error::InvalidHeader : Oodle1Error::None;
 	const auto uniqueLitCount = header[1] & 0x1FF;
 	for (auto& decoder : litDecoders) {
 		decoder.Initialize(litAlphabetSize, uniqueLitCount);
 	}
-	// Initialize repeat-length decoders
+	// Repeat-length and four-byte offset decoders are initialized on first use (see LenDecoder /
+	// Off4Decoder), since most streams only ever select a few of them
 	auto repLens = header[2];
-	for (auto groupIdx = 0u; groupIdx < 4u; groupIdx++) {
-		for (auto decoderIdx = 0u; decoderIdx < 16; decoderIdx++) {
-			auto& decoder = lenDecoders[(groupIdx * 16) + decoderIdx];
-			decoder.Initialize(65, repLens >> 24);
-		}
+	for (auto& uniqueLens : lenUniqueSymbols) {
+		uniqueLens = repLens >> 24;
 		repLens <<= 8;
 	}
-	lenDecoders[64].Initialize(65, repLens >> 24);
+	lenReady.reset();
 	// Initialize repeat-offset decoders
 	offset1AlphabetSize = std::min(4u, windowSize + 1);
-	const auto offset4AlphabetSize = std::min(256u, (windowSize / 4) + 1);
+	offset4AlphabetSize = std::min(256u, (windowSize / 4) + 1);
 	const auto offset1024AlphabetSize = (windowSize / 1024) + 1;
 	const auto largest1KOffset = header[1] >> 19;
 	off1Decoder.Initialize(offset1AlphabetSize, offset1AlphabetSize);
-	for (auto& decoder : off4Decoders) {
-		decoder.Initialize(offset4AlphabetSize, offset4AlphabetSize);
-	}
+	off4Ready.reset();
 	off1024Decoder.Initialize(offset1024AlphabetSize, largest1KOffset + 1);
 }
 
+void Oodle1Decompressor::SaveState(std::vector<uint8_t>& state) const {
+	AppendLE(state, bytesOutput);
+	AppendLE(state, lastRepeatCode);
+	AppendLE(state, pendingOffset);
+	AppendLE(state, pendingLength);
+	for (const auto& decoder : litDecoders) {
+		decoder.Save(state);
+	}
+	off1Decoder.Save(state);
+	off1024Decoder.Save(state);
+	// Only the decoders initialized so far are saved; the rest are still initialized on first use
+	for (auto lastCode = 0u; lastCode < lenDecoders.size(); lastCode++) {
+		AppendLE(state, static_cast<uint8_t>(lenReady[lastCode]));
+		if (lenReady[lastCode]) {
+			lenDecoders[lastCode].Save(state);
+		}
+	}
+	for (auto off1k = 0u; off1k < off4Decoders.size(); off1k++) {
+		AppendLE(state, static_cast<uint8_t>(off4Ready[off1k]));
+		if (off4Ready[off1k]) {
+			off4Decoders[off1k].Save(state);
+		}
+	}
+}
+
+bool Oodle1Decompressor::RestoreState(const uint8_t *state, size_t size, uint64_t position, size_t history) {
+	const auto end = state + size;
+	uint32_t outputCount, lastCode, offset, length;
+	if (!ReadLE(state, end, outputCount) || !ReadLE(state, end, lastCode) || !ReadLE(state, end, offset) || !ReadLE(state, end, length)) {
+		return false;
+	}
+	// The checked policy only stops repeats reaching back before the start of the output as a whole, so the history
+	// has to cover every offset the header allows, unless it's the whole of the output so far
+	if ((headerError != Oodle1Error::None) || ((static_cast<uint64_t>(outputCount) - length) != position) || (lastCode >= lenDecoders.size()) ||
+			(length > RepeatLengthTable[64]) || (length && (!offset || (offset > history))) ||
+			(history > position) || (history < std::min<uint64_t>(position, static_cast<uint64_t>(windowSize) + 1024u))) {
+		return false;
+	}
+	for (auto& decoder : litDecoders) {
+		if (!decoder.Restore(state, end)) {
+			return false;
+		}
+	}
+	if (!off1Decoder.Restore(state, end) || !off1024Decoder.Restore(state, end)) {
+		return false;
+	}
+	for (auto code = 0u; code < lenDecoders.size(); code++) {
+		uint8_t ready;
+		if (!ReadLE(state, end, ready) || (ready > 1) || (ready && !LenDecoder(code).Restore(state, end))) {
+			return false;
+		}
+	}
+	for (auto off1k = 0u; off1k < off4Decoders.size(); off1k++) {
+		uint8_t ready;
+		if (!ReadLE(state, end, ready) || (ready > 1) || (ready && !Off4Decoder(off1k).Restore(state, end))) {
+			return false;
+		}
+	}
+	bytesOutput = outputCount;
+	lastRepeatCode = lastCode;
+	pendingOffset = offset;
+	pendingLength = length;
+	return state == end;
+}
+
 static void Repeat(uint8_t *output, uint32_t offset, uint32_t length) {
 	const uint8_t *input = output - offset;
 	while (length) {
@@ -181,20 +551,80 @@ static void Repeat(uint8_t *output, uint32_t offset, uint32_t length) {
 	}
 }
 
+// Copies in blocks of Width bytes; since each block's source lies at least Width bytes behind it, every
+// block only reads bytes that have already been written, as the byte-at-a-time copy would. With Slack,
+// the final block may run up to Width - 1 bytes past the end of the repeat
+template <uint32_t Width, bool Slack> static void RepeatBlocks(uint8_t *output, const uint8_t *input, uint32_t length) {
+	while (length >= Width) {
+		std::memcpy(output, input, Width);
+		output += Width;
+		input += Width;
+		length -= Width;
+	}
+	if (Slack && length) {
+		std::memcpy(output, input, Width);
+	} else {
+		Repeat(output, output - input, length);
+	}
+}
+
+// For offsets which divide 8, the repeat is a pattern with an 8-byte period, written 8 bytes at a time
+template <bool Slack> static void RepeatPattern(uint8_t *output, uint32_t offset, uint32_t length) {
+	const uint8_t *input = output - offset;
+	uint8_t pattern[8];
+	for (auto idx = 0u; idx < sizeof(pattern); idx++) {
+		pattern[idx] = input[idx % offset];
+	}
+	while (length >= sizeof(pattern)) {
+		std::memcpy(output, pattern, sizeof(pattern));
+		output += sizeof(pattern);
+		length -= sizeof(pattern);
+	}
+	if (Slack && length) {
+		std::memcpy(output, pattern, sizeof(pattern));
+	} else {
+		std::memcpy(output, pattern, length);
+	}
+}
+
+// Wide-copy equivalent of Repeat, for the same overlapping semantics. With Slack, up to
+// Oodle1Decompressor::RepeatSlack bytes past the end of the repeat may be overwritten
+template <bool Slack> static void RepeatWide(uint8_t *output, uint32_t offset, uint32_t length) {
+	if (offset >= 32) {
+		RepeatBlocks<32,Slack>(output, output - offset, length);
+	} else if (offset >= 16) {
+		RepeatBlocks<16,Slack>(output, output - offset, length);
+	} else if (offset >= 8) {
+		RepeatBlocks<8,Slack>(output, output - offset, length);
+	} else if (offset == 1) {
+		std::memset(output, output[-1], length);
+	} else if ((offset == 2) || (offset == 4)) {
+		RepeatPattern<Slack>(output, offset, length);
+	} else {
+		Repeat(output, offset, length);
+	}
+}
+
 uint32_t Oodle1Decompressor::Decompress(uint8_t *output) {
-	const auto lenCode = lenDecoders[lastRepeatCode].Decode(bs, 65);
+	if (pendingLength) {
+		const auto len = pendingLength;
+		pendingLength = 0;
+		Repeat(output, pendingOffset, len);
+		return len;
+	}
+	const auto lenCode = LenDecoder(lastRepeatCode).Decode(*bs, 65);
 	lastRepeatCode = lenCode;
 	if (!lenCode) {
-		const auto lit = litDecoders[bytesOutput & 0x03].Decode(bs, litAlphabetSize);
+		const auto lit = litDecoders[bytesOutput & 0x03].Decode(*bs, litAlphabetSize);
 		output[0] = lit;
 		bytesOutput++;
 		return 1;
 	} else {
 		const auto len = RepeatLengthTable[lenCode];
 		const auto effectiveWindow = std::min(windowSize, bytesOutput);
-		const auto off1 = off1Decoder.Decode(bs, offset1AlphabetSize) + 1;
-		const auto off1k = off1024Decoder.Decode(bs, (effectiveWindow / 1024) + 1);
-		const auto off4 = off4Decoders[off1k].Decode(bs, std::min(256u, (effectiveWindow / 4) + 1));
+		const auto off1 = off1Decoder.Decode(*bs, offset1AlphabetSize) + 1;
+		const auto off1k = off1024Decoder.Decode(*bs, (effectiveWindow / 1024) + 1);
+		const auto off4 = Off4Decoder(off1k).Decode(*bs, std::min(256u, (effectiveWindow / 4) + 1));
 		const auto offset = (off1k * 1024) + (off4 * 4) + off1;
 		bytesOutput += len;
 		Repeat(output, offset, len);
@@ -202,4 +632,389 @@ uint32_t Oodle1Decompressor::Decompress(uint8_t *output) {
 	}
 }
 
+template <typename Policy, bool Slack> bool Oodle1Decompressor::BeginBlock(Cursor& cursor, uint8_t *output, size_t length) {
+	if (Policy::CheckBounds && ((error != Oodle1Error::None) || (headerError != Oodle1Error::None))) {
+		error = (error != Oodle1Error::None) ? error : headerError;
+		return false;
+	}
+	cursor.output = output;
+	cursor.length = length;
+	cursor.produced = 0u;
+	cursor.outputCount = bytesOutput;
+	cursor.lastCode = lastRepeatCode;
+	if (pendingLength) {
+		const auto len = static_cast<uint32_t>(std::min<size_t>(pendingLength, length));
+		RepeatWide<Slack>(output, pendingOffset, len);
+		pendingLength -= len;
+		cursor.produced += len;
+	}
+	return true;
+}
+
+template <typename Policy, bool Slack, typename Engine> inline bool Oodle1Decompressor::DecodeToken(Oodle1Bitstream& stream, uint8_t *output, size_t length, size_t& produced,
+		uint32_t& outputCount, uint32_t& lastCode) {
+	const auto lenCode = LenDecoder(lastCode).template Decode<Policy,65u>(stream, 65, DecoderStats<Policy>(stats.lengthDecoders[lastCode]));
+	if (Policy::CheckBounds && (lenCode == Oodle1InvalidSymbol)) {
+		error = Oodle1Error::SymbolOutOfRange;
+		return false;
+	}
+	lastCode = lenCode;
+	if (Policy::CollectStats) {
+		stats.lengthCodes[lenCode]++;
+	}
+	if (!lenCode) {
+		const auto lit = litDecoders[outputCount & 0x03].template Decode<Policy,Engine::LitAlphabetSize>(stream, litAlphabetSize,
+				DecoderStats<Policy>(stats.literalDecoders[outputCount & 0x03]));
+		if (Policy::CheckBounds && (lit == Oodle1InvalidSymbol)) {
+			error = Oodle1Error::SymbolOutOfRange;
+			return false;
+		}
+		output[produced] = lit;
+		outputCount++;
+		produced++;
+		if (Policy::CollectStats) {
+			stats.literals++;
+		}
+	} else {
+		const auto len = RepeatLengthTable[lenCode];
+		const auto effectiveWindow = std::min(windowSize, outputCount);
+		const auto off1 = off1Decoder.template Decode<Policy,Engine::Offset1AlphabetSize>(stream, offset1AlphabetSize, DecoderStats<Policy>(stats.offset1Decoder));
+		const auto off1k = off1024Decoder.template Decode<Policy>(stream, (effectiveWindow / 1024) + 1, DecoderStats<Policy>(stats.offset1024Decoder));
+		if (Policy::CheckBounds && ((off1 == Oodle1InvalidSymbol) || (off1k == Oodle1InvalidSymbol))) {
+			error = Oodle1Error::SymbolOutOfRange;
+			return false;
+		} else if (Policy::CheckBounds && (off1k >= off4Decoders.size())) {
+			error = Oodle1Error::OffsetOutOfRange;
+			return false;
+		}
+		const auto off4 = Off4Decoder(off1k).template Decode<Policy>(stream, std::min(256u, (effectiveWindow / 4) + 1), DecoderStats<Policy>(stats.offset4Decoders[off1k]));
+		if (Policy::CheckBounds && (off4 == Oodle1InvalidSymbol)) {
+			error = Oodle1Error::SymbolOutOfRange;
+			return false;
+		}
+		const auto offset = (off1k * 1024) + (off4 * 4) + off1 + 1;
+		if (Policy::CheckBounds && (offset > outputCount)) {
+			error = Oodle1Error::OffsetOutOfRange;
+			return false;
+		}
+		outputCount += len;
+		if (Policy::CollectStats) {
+			stats.repeats++;
+			stats.repeatBytes += len;
+		}
+		// Stop exactly at the requested length, even mid-repeat; the remainder is replayed by the next call
+		const auto copyLen = static_cast<uint32_t>(std::min<size_t>(len, length - produced));
+		RepeatWide<Slack>(&output[produced], offset, copyLen);
+		produced += copyLen;
+		if (copyLen < len) {
+			pendingOffset = offset;
+			pendingLength = len - copyLen;
+		}
+	}
+	return true;
+}
+
+void Oodle1Decompressor::EndBlock(const Cursor& cursor) {
+	*bs = cursor.stream;
+	bytesOutput = cursor.outputCount;
+	lastRepeatCode = cursor.lastCode;
+}
+
+template <typename Policy, bool Slack, typename Engine> size_t Oodle1Decompressor::DecompressBlock(uint8_t *output, size_t length, size_t inputReserve) {
+	const auto startCycles = Policy::CollectStats ? ReadCycles() : 0u;
+	Cursor cursor = { this, nullptr, *bs, output, length, 0u, 0u, 0u, Slack };
+	if (!BeginBlock<Policy,Slack>(cursor, output, length)) {
+		return 0;
+	}
+	// The cursor's fields are taken apart again, so that those the decode doesn't hand to the decoders stay in
+	// registers, and aren't reloaded after every byte of output
+	auto stream = cursor.stream;
+	auto produced = cursor.produced;
+	auto outputCount = cursor.outputCount;
+	auto lastCode = cursor.lastCode;
+	while ((produced < length) && (stream.InputRemaining() >= inputReserve)) {
+		if (!DecodeToken<Policy,Slack,Engine>(stream, output, length, produced, outputCount, lastCode)) {
+			break;
+		}
+	}
+	*bs = stream;
+	bytesOutput = outputCount;
+	lastRepeatCode = lastCode;
+	if (Policy::CollectStats) {
+		stats.bytes += produced;
+		stats.cycles += ReadCycles() - startCycles;
+		statsCollected = true;
+	}
+	return produced;
+}
+
+// Each round decodes a token from every lane, in a loop with a fixed number of lanes, so that the compiler
+// can keep every lane's state in registers. Once any lane finishes, it's dropped, and the rest carry on. Each
+// lane's own slack picks its copy routine per token, a branch which always goes the same way for that lane, so
+// that lanes with and without slack still advance together
+template <typename Policy, typename Engine, size_t Lanes> void Oodle1Decompressor::DecompressLanes(Cursor *cursors) {
+	auto running = true;
+	while (running) {
+		for (auto laneIdx = 0u; laneIdx < Lanes; laneIdx++) {
+			auto& cursor = cursors[laneIdx];
+			auto& decomp = *cursor.decomp;
+			const auto decoded = cursor.slack ?
+					decomp.template DecodeToken<Policy,true,Engine>(cursor.stream, cursor.output, cursor.length, cursor.produced, cursor.outputCount, cursor.lastCode) :
+					decomp.template DecodeToken<Policy,false,Engine>(cursor.stream, cursor.output, cursor.length, cursor.produced, cursor.outputCount, cursor.lastCode);
+			running &= decoded && (cursor.produced < cursor.length);
+		}
+	}
+	size_t remaining = 0u;
+	for (auto laneIdx = 0u; laneIdx < Lanes; laneIdx++) {
+		auto& cursor = cursors[laneIdx];
+		if ((cursor.produced >= cursor.length) || (Policy::CheckBounds && (cursor.decomp->error != Oodle1Error::None))) {
+			cursor.decomp->EndBlock(cursor);
+			cursor.lane->decompressed = cursor.produced;
+		} else {
+			cursors[remaining++] = cursor;
+		}
+	}
+	DecompressLaneSet<Policy,Engine>(cursors, remaining);
+}
+
+template <typename Policy, typename Engine> void Oodle1Decompressor::DecompressLaneSet(Cursor *cursors, size_t count) {
+	static_assert(MaxLanes == 4u, "Every lane count up to MaxLanes needs a case");
+	switch (count) {
+		case 4u: DecompressLanes<Policy,Engine,4>(cursors); break;
+		case 3u: DecompressLanes<Policy,Engine,3>(cursors); break;
+		case 2u: DecompressLanes<Policy,Engine,2>(cursors); break;
+		case 1u: DecompressLanes<Policy,Engine,1>(cursors); break;
+		default: break;
+	}
+}
+
+template <typename Policy> void Oodle1Decompressor::DecompressInterleaved(Oodle1Lane *lanes, size_t laneCount) {
+	static_assert(!Policy::CollectStats, "Interleaved lanes can't be timed separately, so can't collect stats");
+	for (size_t groupStart = 0u; groupStart < laneCount; groupStart += MaxLanes) {
+		std::array<Cursor,MaxLanes> cursors;
+		size_t cursorCount = 0u;
+		// The byte engine is only used if every lane in the group suits it
+		auto byteEngine = true;
+		for (auto laneIdx = groupStart; laneIdx < std::min<size_t>(groupStart + MaxLanes, laneCount); laneIdx++) {
+			auto& lane = lanes[laneIdx];
+			auto& decomp = *lane.decomp;
+			byteEngine = byteEngine && decomp.SuitsByteEngine();
+			auto& cursor = cursors[cursorCount];
+			cursor = { &decomp, &lane, *decomp.bs, lane.output, lane.length, 0u, 0u, 0u, lane.outputSlack };
+			lane.decompressed = 0u;
+			const auto began = lane.outputSlack ? decomp.BeginBlock<Policy,true>(cursor, lane.output, lane.length) :
+					decomp.BeginBlock<Policy,false>(cursor, lane.output, lane.length);
+			if (!began) {
+				continue;
+			} else if (cursor.produced >= cursor.length) {
+				decomp.EndBlock(cursor);
+				lane.decompressed = cursor.produced;
+			} else {
+				cursorCount++;
+			}
+		}
+		if (byteEngine) {
+			DecompressLaneSet<Policy,ByteEngine>(cursors.data(), cursorCount);
+		} else {
+			DecompressLaneSet<Policy,GenericEngine>(cursors.data(), cursorCount);
+		}
+	}
+}
+
+template <typename Policy> size_t Oodle1Decompressor::Decompress(uint8_t *output, size_t length, bool outputSlack) {
+	return Decompress<Policy>(output, length, 0u, outputSlack);
+}
+
+template <typename Policy> size_t Oodle1Decompressor::Decompress(uint8_t *output, size_t length, size_t inputReserve, bool outputSlack) {
+	// The engine is picked afresh for every call, though it only depends on the header
+	const auto byteEngine = SuitsByteEngine();
+	if (outputSlack) {
+		return byteEngine ? DecompressBlock<Policy,true,ByteEngine>(output, length, inputReserve) :
+				DecompressBlock<Policy,true,GenericEngine>(output, length, inputReserve);
+	} else {
+		return byteEngine ? DecompressBlock<Policy,false,ByteEngine>(output, length, inputReserve) :
+				DecompressBlock<Policy,false,GenericEngine>(output, length, inputReserve);
+	}
+}
+
+template size_t Oodle1Decompressor::Decompress<Oodle1Unchecked>(uint8_t *output, size_t length, bool outputSlack);
+template size_t Oodle1Decompressor::Decompress<Oodle1Checked>(uint8_t *output, size_t length, bool outputSlack);
+template size_t Oodle1Decompressor::Decompress<Oodle1Unchecked>(uint8_t *output, size_t length, size_t inputReserve, bool outputSlack);
+template size_t Oodle1Decompressor::Decompress<Oodle1Checked>(uint8_t *output, size_t length, size_t inputReserve, bool outputSlack);
+template size_t Oodle1Decompressor::Decompress<Oodle1WithStats<Oodle1Unchecked>>(uint8_t *output, size_t length, bool outputSlack);
+template size_t Oodle1Decompressor::Decompress<Oodle1WithStats<Oodle1Checked>>(uint8_t *output, size_t length, bool outputSlack);
+template size_t Oodle1Decompressor::Decompress<Oodle1WithStats<Oodle1Unchecked>>(uint8_t *output, size_t length, size_t inputReserve, bool outputSlack);
+template size_t Oodle1Decompressor::Decompress<Oodle1WithStats<Oodle1Checked>>(uint8_t *output, size_t length, size_t inputReserve, bool outputSlack);
+template void Oodle1Decompressor::DecompressInterleaved<Oodle1Unchecked>(Oodle1Lane *lanes, size_t laneCount);
+template void Oodle1Decompressor::DecompressInterleaved<Oodle1Checked>(Oodle1Lane *lanes, size_t laneCount);
+
+Oodle1StreamDecompressor::Oodle1StreamDecompressor(const uint32_t *header_) :
+		decomp(std::make_unique<Oodle1Decompressor>()), bs(nullptr, 0u) {
+	std::copy(header_, header_ + header.size(), header.begin());
+	windowHistory = Oodle1Decompressor::MaxHistory(header.data());
+	window.resize(windowHistory + std::max<size_t>(windowHistory, MinWindowChunk) + Oodle1Decompressor::RepeatSlack);
+}
+
+void Oodle1StreamDecompressor::Feed(const uint8_t *input_, size_t length, bool final) {
+	// Drop whatever input has already been consumed, so that only the unread remainder is held
+	if (started && bsState.inputOffset) {
+		input.erase(input.begin(), input.begin() + bsState.inputOffset);
+		bsState.inputOffset = 0u;
+	}
+	input.insert(input.end(), input_, input_ + length);
+	inputFinal = inputFinal || final;
+}
+
+size_t Oodle1StreamDecompressor::Decompress(const uint8_t *&output, size_t maxLength) {
+	const auto inputReserve = inputFinal ? 0u : Oodle1Decompressor::MaxTokenInput;
+	if (!started) {
+		if (input.size() < inputReserve) {
+			return 0;
+		}
+		bs = Oodle1Bitstream(input.data(), input.size());
+		decomp->Reset(bs, header.data());
+		started = true;
+	} else {
+		bs = Oodle1Bitstream(input.data(), input.size(), bsState);
+	}
+	// Once the window fills, everything but the history that repeats may still refer to is slid back to the start
+	const auto windowCapacity = window.size() - Oodle1Decompressor::RepeatSlack;
+	if (windowEnd == windowCapacity) {
+		std::memmove(window.data(), &window[windowEnd - windowHistory], windowHistory);
+		windowEnd = windowHistory;
+	}
+	const auto length = std::min(maxLength, windowCapacity - windowEnd);
+	const auto produced = decomp->Decompress<Oodle1Checked>(&window[windowEnd], length, inputReserve, true);
+	bsState = bs.Save(input.data());
+	output = &window[windowEnd];
+	windowEnd += produced;
+	return produced;
+}
+
+bool Oodle1CheckpointIndex::Build(const uint32_t *header_, const uint8_t *input, size_t inputLength, uint8_t *output, size_t length_,
+		size_t interval, bool outputSlack) {
+	std::copy(header_, header_ + header.size(), header.begin());
+	length = length_;
+	checkpoints.clear();
+	if (!decomp) {
+		decomp = std::make_unique<Oodle1Decompressor>();
+	}
+	Oodle1Bitstream bs(input, inputLength);
+	decomp->Reset(bs, header.data());
+	const auto maxHistory = Oodle1Decompressor::MaxHistory(header.data());
+	interval = std::max<size_t>(interval, 1u);
+	for (size_t position = 0u; position < length_; position += interval) {
+		Checkpoint checkpoint;
+		checkpoint.position = position;
+		checkpoint.stream = bs.Save(input);
+		const auto history = std::min(position, maxHistory);
+		checkpoint.history.assign(output + position - history, output + position);
+		decomp->SaveState(checkpoint.state);
+		checkpoints.push_back(std::move(checkpoint));
+		// Slack past a checkpoint is overwritten by the decode that follows; only the last needs the caller's
+		const auto chunk = std::min(interval, length_ - position);
+		const auto slack = outputSlack || ((length_ - position - chunk) >= Oodle1Decompressor::RepeatSlack);
+		if (decomp->Decompress<Oodle1Checked>(output + position, chunk, slack) != chunk) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t Oodle1CheckpointIndex::Read(const uint8_t *input, size_t inputLength, uint64_t offset, uint8_t *output, size_t readLength) {
+	if ((offset >= length) || checkpoints.empty()) {
+		return 0;
+	}
+	readLength = static_cast<size_t>(std::min<uint64_t>(readLength, length - offset));
+	const auto next = std::upper_bound(checkpoints.begin(), checkpoints.end(), offset, [](uint64_t value, const Checkpoint& checkpoint) {
+		return value < checkpoint.position;
+	});
+	const auto& checkpoint = *(next - 1);
+	if (checkpoint.stream.inputOffset > inputLength) {
+		return 0;
+	}
+	// Everything from the checkpoint up to the end of the range is decoded, after the history it may refer back to
+	const auto history = checkpoint.history.size();
+	const auto skip = static_cast<size_t>(offset - checkpoint.position);
+	window.resize(history + skip + readLength + Oodle1Decompressor::RepeatSlack);
+	std::copy(checkpoint.history.begin(), checkpoint.history.end(), window.begin());
+	if (!decomp) {
+		decomp = std::make_unique<Oodle1Decompressor>();
+	}
+	Oodle1Bitstream bs(input, inputLength, checkpoint.stream);
+	decomp->Reset(bs, header.data());
+	if (!decomp->RestoreState(checkpoint.state.data(), checkpoint.state.size(), checkpoint.position, history)) {
+		return 0;
+	}
+	const auto produced = decomp->Decompress<Oodle1Checked>(&window[history], skip + readLength, true);
+	if (produced <= skip) {
+		return 0;
+	}
+	std::copy(&window[history + skip], &window[history + produced], output);
+	return produced - skip;
+}
+
+void Oodle1CheckpointIndex::Save(std::vector<uint8_t>& data) const {
+	AppendLE(data, Signature);
+	for (const auto word : header) {
+		AppendLE(data, word);
+	}
+	AppendLE(data, length);
+	AppendLE(data, static_cast<uint32_t>(checkpoints.size()));
+	for (const auto& checkpoint : checkpoints) {
+		AppendLE(data, checkpoint.position);
+		AppendLE(data, checkpoint.stream.inputOffset);
+		AppendLE(data, checkpoint.stream.sr);
+		AppendLE(data, checkpoint.stream.srModulus);
+		AppendLE(data, checkpoint.stream.lsb);
+		AppendLE(data, static_cast<uint32_t>(checkpoint.state.size()));
+		data.insert(data.end(), checkpoint.state.begin(), checkpoint.state.end());
+		data.insert(data.end(), checkpoint.history.begin(), checkpoint.history.end());
+	}
+}
+
+// The decoder state itself is only checked once a read restores it; here, the checkpoints just have to be in order,
+// with the history that Build would have given them, and a bitstream state the bitstream can resume from
+bool Oodle1CheckpointIndex::Load(const uint8_t *data, size_t size) {
+	const auto end = data + size;
+	uint32_t signature, checkpointCount;
+	std::array<uint32_t,3> loadedHeader;
+	uint64_t loadedLength;
+	checkpoints.clear();
+	length = 0u;
+	if (!ReadLE(data, end, signature) || (signature != Signature) || !ReadLE(data, end, loadedHeader[0]) ||
+			!ReadLE(data, end, loadedHeader[1]) || !ReadLE(data, end, loadedHeader[2]) || !ReadLE(data, end, loadedLength) ||
+			!ReadLE(data, end, checkpointCount)) {
+		return false;
+	}
+	const auto maxHistory = Oodle1Decompressor::MaxHistory(loadedHeader.data());
+	std::vector<Checkpoint> loaded;
+	for (auto checkpointIdx = 0u; checkpointIdx < checkpointCount; checkpointIdx++) {
+		Checkpoint checkpoint;
+		uint32_t stateSize;
+		if (!ReadLE(data, end, checkpoint.position) || !ReadLE(data, end, checkpoint.stream.inputOffset) ||
+				!ReadLE(data, end, checkpoint.stream.sr) || !ReadLE(data, end, checkpoint.stream.srModulus) ||
+				!ReadLE(data, end, checkpoint.stream.lsb) || !ReadLE(data, end, stateSize)) {
+			return false;
+		}
+		const auto history = std::min<uint64_t>(checkpoint.position, maxHistory);
+		if ((checkpoint.position >= loadedLength) || (checkpointIdx ? (checkpoint.position <= loaded.back().position) : (checkpoint.position != 0u)) ||
+				!checkpoint.stream.srModulus || (checkpoint.stream.lsb > 1) || (static_cast<uint64_t>(end - data) < (stateSize + history))) {
+			return false;
+		}
+		checkpoint.state.assign(data, data + stateSize);
+		data += stateSize;
+		checkpoint.history.assign(data, data + history);
+		data += history;
+		loaded.push_back(std::move(checkpoint));
+	}
+	if ((data != end) || (loadedLength && loaded.empty())) {
+		return false;
+	}
+	header = loadedHeader;
+	length = loadedLength;
+	checkpoints = std::move(loaded);
+	return true;
+}
+
 }
@@ -0,0 +1,103 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <oodle/Oodle1Batch.h>
+
+namespace Oodle {
+
+Oodle1BatchDecompressor::Oodle1BatchDecompressor(unsigned threads, unsigned lanes) :
+		threadCount(std::max(threads, 1u)), laneCount(std::clamp(lanes, 1u, Oodle1Decompressor::MaxLanes)),
+		decomps(threadCount * laneCount) { }
+
+template <typename Policy> bool Oodle1BatchDecompressor::Decompress(Oodle1BatchJob *jobs, size_t jobCount) {
+	std::atomic<size_t> nextJobIdx(0u);
+	std::atomic<bool> failed(false);
+	const auto worker = [&](size_t threadIdx) {
+		// Decompressors are large enough that allocating (and first touching) one would cost more than
+		// decoding a small job, so each thread's are kept for the life of the batch decompressor
+		const auto threadDecomps = &decomps[threadIdx * laneCount];
+		for (auto laneIdx = 0u; laneIdx < laneCount; laneIdx++) {
+			if (!threadDecomps[laneIdx]) {
+				threadDecomps[laneIdx] = std::make_unique<Oodle1Decompressor>();
+			}
+		}
+		std::array<Oodle1Bitstream,Oodle1Decompressor::MaxLanes> streams = {
+			Oodle1Bitstream(nullptr, 0u), Oodle1Bitstream(nullptr, 0u), Oodle1Bitstream(nullptr, 0u), Oodle1Bitstream(nullptr, 0u),
+		};
+		std::array<Oodle1Lane,Oodle1Decompressor::MaxLanes> lanes;
+		for (;;) {
+			const auto claimStart = nextJobIdx.fetch_add(JobsPerClaim);
+			if (claimStart >= jobCount) {
+				break;
+			}
+			const auto claimEnd = std::min<size_t>(claimStart + JobsPerClaim, jobCount);
+			for (auto groupStart = claimStart; groupStart < claimEnd; groupStart += laneCount) {
+				const auto groupSize = std::min(laneCount, claimEnd - groupStart);
+				for (auto laneIdx = 0u; laneIdx < groupSize; laneIdx++) {
+					const auto& job = jobs[groupStart + laneIdx];
+					auto& lane = lanes[laneIdx];
+					streams[laneIdx] = Oodle1Bitstream(job.input, job.inputLength);
+					lane.decomp = threadDecomps[laneIdx].get();
+					lane.decomp->Reset(streams[laneIdx], job.header);
+					lane.output = job.output;
+					lane.length = job.outputLength;
+					lane.outputSlack = job.outputSlack;
+				}
+				if (groupSize > 1u) {
+					Oodle1Decompressor::DecompressInterleaved<Policy>(lanes.data(), groupSize);
+				} else {
+					lanes[0].decompressed = lanes[0].decomp->template Decompress<Policy>(lanes[0].output, lanes[0].length, lanes[0].outputSlack);
+				}
+				for (auto laneIdx = 0u; laneIdx < groupSize; laneIdx++) {
+					auto& job = jobs[groupStart + laneIdx];
+					job.decompressed = lanes[laneIdx].decompressed;
+					job.error = lanes[laneIdx].decomp->GetError();
+					if (job.decompressed != job.outputLength) {
+						failed = true;
+					}
+				}
+			}
+		}
+	};
+
+	// Every thread must have a whole claim of its own, or it isn't worth starting
+	const auto threadsUsed = std::min<size_t>(threadCount, (jobCount + JobsPerClaim - 1) / JobsPerClaim);
+	std::vector<std::thread> workers;
+	for (size_t threadIdx = 1u; threadIdx < threadsUsed; threadIdx++) {
+		workers.emplace_back(worker, threadIdx);
+	}
+	worker(0u);
+	for (auto& thread : workers) {
+		thread.join();
+	}
+	return !failed;
+}
+
+template bool Oodle1BatchDecompressor::Decompress<Oodle1Unchecked>(Oodle1BatchJob *jobs, size_t jobCount);
+template bool Oodle1BatchDecompressor::Decompress<Oodle1Checked>(Oodle1BatchJob *jobs, size_t jobCount);
+
+}
@@ -0,0 +1,473 @@
+// This is free and unencumbered software released into the public domain.
+//
+// Anyone is free to copy, modify, publish, use, compile, sell, or
+// distribute this software, either in source code form or as a compiled
+// binary, for any purpose, commercial or non-commercial, and by any
+// means.
+//
+// In jurisdictions that recognize copyright laws, the author or authors
+// of this software dedicate any and all copyright interest in the
+// software to the public domain. We make this dedication for the benefit
+// of the public at large and to the detriment of our heirs and
+// successors. We intend this dedication to be an overt act of
+// relinquishment in perpetuity of all present and future rights to this
+// software under copyright law.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+// For more information, please refer to <https://unlicense.org>
+#include <algorithm>
+#include <cmath>
+#include <oodle/Oodle1Compressor.h>
+
+namespace Oodle {
+
+std::vector<uint8_t> Oodle1BitstreamWriter::Finish() const {
+	// The first digit holds 7 bits and the rest hold 8, so every byte holds the low 7 bits of one digit,
+	// followed by the top bit of the next
+	std::vector<uint8_t> bytes(digits.size());
+	for (size_t idx = 0u; idx < digits.size(); idx++) {
+		const auto next = ((idx + 1) < digits.size()) ? digits[idx + 1] : 0u;
+		bytes[idx] = ((digits[idx] & 0x7F) << 1) | (next >> 7);
+	}
+	return bytes;
+}
+
+template <uint32_t Capacity> void Oodle1Encoder<Capacity>::Initialize(uint32_t alphabetSize, uint32_t uniqueSymbols) {
+	model.Initialize(alphabetSize, uniqueSymbols);
+	std::fill(symbolIndices.begin(), symbolIndices.begin() + std::min(alphabetSize, Capacity), 0);
+}
+
+template <uint32_t Capacity> void Oodle1Encoder<Capacity>::IndexSymbols(SymbolIndex value) {
+	for (auto idx = 1u; idx <= model.highestLearnedSymbol; idx++) {
+		symbolIndices[model.symbols[idx]] = value ? idx : 0;
+	}
+}
+
+template <uint32_t Capacity> bool Oodle1Encoder<Capacity>::Encode(Oodle1BitstreamWriter& bs, uint32_t symbol, uint32_t alphabetSize) {
+	constexpr auto One = Oodle1Decoder<Capacity>::One;
+	if (model.totalOccurrence >= model.nextRenormWeight) {
+		if (model.totalOccurrence >= model.decayThreshold) {
+			// Decay drops and reorders symbols, so the index is rebuilt around it
+			IndexSymbols(0);
+			model.Decay();
+			IndexSymbols(1);
+		}
+		model.Renormalize();
+	}
+	if (symbol >= std::min(alphabetSize, Capacity)) {
+		return false;
+	}
+	auto symbolIdx = static_cast<uint32_t>(symbolIndices[symbol]);
+	if (symbolIdx && (symbolIdx <= model.highestNormalizedSymbol)) {
+		const auto span = model.symbolWeights[symbolIdx + 1] - model.symbolWeights[symbolIdx];
+		if (!span) {
+			return false;
+		}
+		bs.Put(model.symbolWeights[symbolIdx], span, One);
+		model.symbolOccurrences[symbolIdx]++;
+		model.totalOccurrence++;
+		return true;
+	}
+
+	// Probationary and new symbols both follow an escape
+	const auto escapeSpan = model.symbolWeights[1] - model.symbolWeights[0];
+	if (!escapeSpan) {
+		return false;
+	}
+	bs.Put(0u, escapeSpan, One);
+	model.symbolOccurrences[0]++;
+	model.totalOccurrence++;
+	if (model.highestLearnedSymbol != model.highestNormalizedSymbol) {
+		if (symbolIdx) {
+			bs.Put(1u, 2u);
+			bs.Put(symbolIdx - model.highestNormalizedSymbol - 1, model.highestLearnedSymbol - model.highestNormalizedSymbol);
+			model.symbolOccurrences[symbolIdx] += 2;
+			model.totalOccurrence += 2;
+			return true;
+		}
+		bs.Put(0u, 2u);
+	}
+	if ((model.highestLearnedSymbol + 3) > model.alphabetLimit) {
+		return false;
+	}
+	model.highestLearnedSymbol++;
+	bs.Put(symbol, alphabetSize);
+	model.symbols[model.highestLearnedSymbol] = symbol;
+	symbolIndices[symbol] = model.highestLearnedSymbol;
+	model.symbolOccurrences[model.highestLearnedSymbol] += 2;
+	model.totalOccurrence += 2;
+	if (model.highestLearnedSymbol == model.usedSymbolCount) {
+		model.totalOccurrence -= model.symbolOccurrences[0];
+		model.symbolOccurrences[0] = 0;
+	}
+	return true;
+}
+
+template class Oodle1Encoder<4>;
+template class Oodle1Encoder<65>;
+template class Oodle1Encoder<256>;
+template class Oodle1Encoder<(Oodle1Decompressor::MaxWindowSize / 1024) + 1>;
+
+// Repeat lengths are coded as 2 through 61 directly, or as one of four longer lengths
+static uint32_t EncodableLength(uint32_t length) {
+	if (length >= 512) {
+		return 512;
+	} else if (length >= 256) {
+		return 256;
+	} else if (length >= 192) {
+		return 192;
+	} else if (length >= 128) {
+		return 128;
+	} else {
+		return std::min(length, 61u);
+	}
+}
+
+static uint32_t LengthCode(uint32_t length) {
+	switch (length) {
+		case 128:
+			return 61;
+		case 192:
+			return 62;
+		case 256:
+			return 63;
+		case 512:
+			return 64;
+		default:
+			return length - 1;
+	}
+}
+
+// Hash chains over every position of a stream, inserted in order. Each match found is the closest one of its
+// length, so offsets only grow as matches lengthen
+class Oodle1MatchFinder {
+public:
+	static constexpr auto HashBits = 16u;
+	static constexpr auto MaxLength = 512u;
+	static constexpr auto None = UINT32_MAX;
+
+	Oodle1MatchFinder(const uint8_t *input_, uint32_t length_, uint32_t maxDepth_) :
+			input(input_), length(length_), maxDepth(maxDepth_), head(1u << HashBits, None), prev(length_, None) { }
+
+	void Insert(uint32_t pos) {
+		if ((pos + Oodle1Compressor::MinMatchLength) <= length) {
+			const auto hash = Hash(pos);
+			prev[pos] = head[hash];
+			head[hash] = pos;
+		}
+	}
+
+	// Calls visit(length, offset) for each match at pos that is longer than those before it. Positions
+	// must be inserted only after they have been searched
+	template <typename Visit> void Find(uint32_t pos, Visit visit) const {
+		const auto maxLength = std::min(MaxLength, length - pos);
+		if (maxLength < Oodle1Compressor::MinMatchLength) {
+			return;
+		}
+		auto bestLength = Oodle1Compressor::MinMatchLength - 1;
+		auto candidate = head[Hash(pos)];
+		for (auto depth = 0u; (depth < maxDepth) && (candidate != None); depth++, candidate = prev[candidate]) {
+			const auto offset = pos - candidate;
+			if (offset > Oodle1Compressor::MaxWindowSize) {
+				break;
+			} else if (input[candidate + bestLength] != input[pos + bestLength]) {
+				continue;
+			}
+			auto matchLength = 0u;
+			while ((matchLength < maxLength) && (input[candidate + matchLength] == input[pos + matchLength])) {
+				matchLength++;
+			}
+			if (matchLength > bestLength) {
+				bestLength = matchLength;
+				visit(matchLength, offset);
+				if (matchLength == maxLength) {
+					break;
+				}
+			}
+		}
+	}
+
+	Oodle1Compressor::Token Best(uint32_t pos) const {
+		Oodle1Compressor::Token best;
+		Find(pos, [&best](uint32_t matchLength, uint32_t offset) {
+			best.length = matchLength;
+			best.offset = offset;
+		});
+		return best;
+	}
+
+private:
+	const uint8_t *input;
+	uint32_t length;
+	uint32_t maxDepth;
+	std::vector<uint32_t> head;
+	std::vector<uint32_t> prev;
+
+	uint32_t Hash(uint32_t pos) const {
+		const auto key = (static_cast<uint32_t>(input[pos]) << 16) | (static_cast<uint32_t>(input[pos + 1]) << 8) | input[pos + 2];
+		return (key * 2654435761u) >> (32 - HashBits);
+	}
+};
+
+static void ParseGreedy(const uint8_t *input, uint32_t length, uint32_t maxDepth, std::vector<Oodle1Compressor::Token>& tokens) {
+	Oodle1MatchFinder finder(input, length, maxDepth);
+	for (auto pos = 0u; pos < length;) {
+		auto token = finder.Best(pos);
+		if (token.length < Oodle1Compressor::MinMatchLength) {
+			token = { 1u, 0u };
+		}
+		token.length = token.offset ? EncodableLength(token.length) : 1u;
+		tokens.push_back(token);
+		for (const auto end = pos + token.length; pos < end; pos++) {
+			finder.Insert(pos);
+		}
+	}
+}
+
+// Defers each match by a byte whenever the match starting one byte later is longer
+static void ParseLazy(const uint8_t *input, uint32_t length, uint32_t maxDepth, std::vector<Oodle1Compressor::Token>& tokens) {
+	Oodle1MatchFinder finder(input, length, maxDepth);
+	Oodle1Compressor::Token current;
+	if (length) {
+		current = finder.Best(0u);
+	}
+	for (auto pos = 0u; pos < length;) {
+		finder.Insert(pos);
+		const auto next = ((pos + 1) < length) ? finder.Best(pos + 1) : Oodle1Compressor::Token();
+		if ((current.length < Oodle1Compressor::MinMatchLength) || (next.length > current.length)) {
+			tokens.push_back({ 1u, 0u });
+			pos++;
+			current = next;
+			continue;
+		}
+		current.length = EncodableLength(current.length);
+		tokens.push_back(current);
+		for (const auto end = pos + current.length; ++pos < end;) {
+			finder.Insert(pos);
+		}
+		current = (pos < length) ? finder.Best(pos) : Oodle1Compressor::Token();
+	}
+}
+
+// Approximate costs in bits, from how often each symbol occurred in a previous parse. The adaptive models
+// can't be priced exactly ahead of time, but their static entropy is a good guide
+struct Oodle1Costs {
+	std::array<float,256> literals;
+	std::array<float,65> lengths;
+	std::array<float,4> offset1s;
+	std::array<float,(Oodle1Compressor::MaxWindowSize / 1024) + 1> offset1ks;
+	std::array<float,256> offset4s;
+
+	template <size_t N> static void Price(std::array<float,N>& costs, const std::array<uint32_t,N>& counts) {
+		auto total = 0.0f;
+		for (const auto count : counts) {
+			total += count + 1;
+		}
+		for (size_t idx = 0u; idx < N; idx++) {
+			costs[idx] = std::log2(total / (counts[idx] + 1));
+		}
+	}
+
+	Oodle1Costs(const uint8_t *input, const std::vector<Oodle1Compressor::Token>& tokens) {
+		std::array<uint32_t,256> literalCounts = { 0 };
+		std::array<uint32_t,65> lengthCounts = { 0 };
+		std::array<uint32_t,4> offset1Counts = { 0 };
+		std::array<uint32_t,(Oodle1Compressor::MaxWindowSize / 1024) + 1> offset1kCounts = { 0 };
+		std::array<uint32_t,256> offset4Counts = { 0 };
+		auto pos = 0u;
+		for (const auto& token : tokens) {
+			if (token.offset) {
+				const auto offset = token.offset - 1;
+				lengthCounts[LengthCode(token.length)]++;
+				offset1Counts[offset & 0x03]++;
+				offset1kCounts[offset >> 10]++;
+				offset4Counts[(offset >> 2) & 0xFF]++;
+			} else {
+				lengthCounts[0]++;
+				literalCounts[input[pos]]++;
+			}
+			pos += token.length;
+		}
+		Price(literals, literalCounts);
+		Price(lengths, lengthCounts);
+		Price(offset1s, offset1Counts);
+		Price(offset1ks, offset1kCounts);
+		Price(offset4s, offset4Counts);
+	}
+
+	float Repeat(uint32_t length, uint32_t offset) const {
+		offset--;
+		return lengths[LengthCode(length)] + offset1s[offset & 0x03] + offset1ks[offset >> 10] + offset4s[(offset >> 2) & 0xFF];
+	}
+};
+
+// Finds the cheapest parse under a static cost model, seeded from a lazy parse, and then re-priced from its
+// own result. Every encodable length of every match is considered, not just the longest, except that a match
+// of NiceLength or more is simply taken, and the positions it covers aren't searched
+static void ParseOptimal(const uint8_t *input, uint32_t length, uint32_t maxDepth, std::vector<Oodle1Compressor::Token>& tokens) {
+	constexpr auto Passes = 2u;
+	constexpr auto NiceLength = 128u;
+	ParseLazy(input, length, maxDepth, tokens);
+	std::vector<float> prices(length + 1);
+	std::vector<Oodle1Compressor::Token> choices(length + 1);
+	for (auto pass = 0u; pass < Passes; pass++) {
+		const Oodle1Costs costs(input, tokens);
+		Oodle1MatchFinder finder(input, length, maxDepth);
+		std::fill(prices.begin(), prices.end(), INFINITY);
+		prices[0] = 0.0f;
+		const auto relax = [&](uint32_t pos, uint32_t tokenLength, uint32_t offset, float price) {
+			if (price < prices[pos + tokenLength]) {
+				prices[pos + tokenLength] = price;
+				choices[pos + tokenLength] = { tokenLength, offset };
+			}
+		};
+		auto skipEnd = 0u;
+		for (auto pos = 0u; pos < length; pos++) {
+			if (pos < skipEnd) {
+				finder.Insert(pos);
+				continue;
+			}
+			relax(pos, 1u, 0u, prices[pos] + costs.lengths[0] + costs.literals[input[pos]]);
+			auto shorterLength = Oodle1Compressor::MinMatchLength - 1;
+			finder.Find(pos, [&](uint32_t matchLength, uint32_t offset) {
+				for (auto tokenLength = shorterLength + 1; tokenLength <= matchLength; tokenLength++) {
+					if (EncodableLength(tokenLength) == tokenLength) {
+						relax(pos, tokenLength, offset, prices[pos] + costs.Repeat(tokenLength, offset));
+					}
+				}
+				shorterLength = matchLength;
+			});
+			if (shorterLength >= NiceLength) {
+				skipEnd = pos + EncodableLength(shorterLength);
+			}
+			finder.Insert(pos);
+		}
+		tokens.clear();
+		for (auto pos = length; pos > 0u; pos -= choices[pos].length) {
+			tokens.push_back(choices[pos]);
+		}
+		std::reverse(tokens.begin(), tokens.end());
+	}
+}
+
+void Oodle1Compressor::Parse(const uint8_t *input, uint32_t length, Oodle1Level level, std::vector<Token>& tokens) {
+	tokens.clear();
+	switch (level) {
+		case Oodle1Level::Fast:
+			ParseGreedy(input, length, 8u, tokens);
+			break;
+		case Oodle1Level::Normal:
+			ParseLazy(input, length, 32u, tokens);
+			break;
+		case Oodle1Level::Optimal:
+		default:
+			ParseOptimal(input, length, 48u, tokens);
+			break;
+	}
+}
+
+bool Oodle1Compressor::Emit(const uint8_t *input, const std::vector<Token>& tokens, uint32_t *header) {
+	// The header describes exactly what the tokens use; smaller alphabets and exact unique-symbol counts
+	// both make for cheaper codes
+	std::bitset<256> literalsSeen;
+	auto largestLiteral = 0u;
+	auto largestOffset = 0u;
+	std::array<std::bitset<65>,4> lengthsSeen;
+	auto lastCode = 0u;
+	auto pos = 0u;
+	for (const auto& token : tokens) {
+		const auto lenCode = token.offset ? LengthCode(token.length) : 0u;
+		if ((lastCode / 16) < lengthsSeen.size()) {
+			lengthsSeen[lastCode / 16].set(lenCode);
+		}
+		lastCode = lenCode;
+		if (token.offset) {
+			largestOffset = std::max(largestOffset, token.offset - 1);
+		} else {
+			literalsSeen.set(input[pos]);
+			largestLiteral = std::max<uint32_t>(largestLiteral, input[pos]);
+		}
+		pos += token.length;
+	}
+	const auto windowSize = largestOffset;
+	const auto litAlphabetSize = largestLiteral + 1;
+	header[0] = (windowSize << 9) | litAlphabetSize;
+	header[1] = ((largestOffset >> 10) << 19) | static_cast<uint32_t>(literalsSeen.count());
+	header[2] = 0u;
+	for (const auto& seen : lengthsSeen) {
+		header[2] = (header[2] << 8) | static_cast<uint32_t>(seen.count());
+	}
+
+	// From here on, this mirrors Oodle1Decompressor::Initialize and DecompressBlock
+	const auto offset1AlphabetSize = std::min(4u, windowSize + 1);
+	const auto offset4AlphabetSize = std::min(256u, (windowSize / 4) + 1);
+	std::array<uint32_t,5> lenUniqueSymbols = { header[2] >> 24, (header[2] >> 16) & 0xFF, (header[2] >> 8) & 0xFF, header[2] & 0xFF, 0u };
+	for (auto& encoder : litEncoders) {
+		encoder.Initialize(litAlphabetSize, header[1] & 0x1FF);
+	}
+	lenReady.reset();
+	off1Encoder.Initialize(offset1AlphabetSize, offset1AlphabetSize);
+	off4Ready.reset();
+	off1024Encoder.Initialize((windowSize / 1024) + 1, (header[1] >> 19) + 1);
+
+	lastCode = 0u;
+	pos = 0u;
+	for (const auto& token : tokens) {
+		const auto lenCode = token.offset ? LengthCode(token.length) : 0u;
+		if (!lenReady[lastCode]) {
+			lenEncoders[lastCode].Initialize(65, lenUniqueSymbols[lastCode / 16]);
+			lenReady[lastCode] = true;
+		}
+		if (!lenEncoders[lastCode].Encode(bs, lenCode, 65)) {
+			return false;
+		}
+		lastCode = lenCode;
+		if (!token.offset) {
+			if (!litEncoders[pos & 0x03].Encode(bs, input[pos], litAlphabetSize)) {
+				return false;
+			}
+		} else {
+			const auto effectiveWindow = std::min(windowSize, pos);
+			const auto offset = token.offset - 1;
+			const auto off1k = offset >> 10;
+			if (!off4Ready[off1k]) {
+				off4Encoders[off1k].Initialize(offset4AlphabetSize, offset4AlphabetSize);
+				off4Ready[off1k] = true;
+			}
+			if (!off1Encoder.Encode(bs, offset & 0x03, offset1AlphabetSize) ||
+					!off1024Encoder.Encode(bs, off1k, (effectiveWindow / 1024) + 1) ||
+					!off4Encoders[off1k].Encode(bs, (offset >> 2) & 0xFF, std::min(256u, (effectiveWindow / 4) + 1))) {
+				return false;
+			}
+		}
+		pos += token.length;
+	}
+	return true;
+}
+
+bool Oodle1Compressor::Compress(const uint8_t *input, size_t length, uint32_t *header) {
+	if (length > UINT32_MAX) {
+		return false;
+	}
+	Parse(input, static_cast<uint32_t>(length), level, tokens);
+	return Emit(input, tokens, header);
+}
+
+bool Oodle1Compressor::Compress(const uint8_t *input, const std::vector<Token>& tokens, uint32_t *header) {
+	return Emit(input, tokens, header);
+}
+
+std::vector<uint8_t> Oodle1Compressor::Finish() {
+	auto bytes = bs.Finish();
+	bs.Reset();
+	return bytes;
+}
+
+}